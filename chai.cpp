@@ -3,16 +3,29 @@
 int main(int argc, char* argv[]) 
 { 
     command::add_command_option(std::string("help"), command::handle_help);
+    command::add_command_option(std::string("serve"), command::handle_serve);
     command::add_command_option(std::string("init"), command::handle_init);
     command::add_command_option(std::string("info"), command::handle_info);
     command::add_command_option(std::string("reset"), command::handle_reset);
     command::add_command_option(std::string("build"), command::handle_build);
+    command::add_command_option(std::string("build"), command::handle_build_with_option);
     command::add_command_option(std::string("run"), command::handle_run);
+    command::add_command_option(std::string("debug"), command::handle_debug);
+    command::add_command_option(std::string("history"), command::handle_history);
+    command::add_command_option(std::string("analyze"), command::handle_analyze);
+    command::add_command_option(std::string("watch"), command::handle_watch);
+    command::add_command_option(std::string("tune"), command::handle_tune);
+    command::add_command_option(std::string("watch"), command::handle_watch_and_run);
+    command::add_command_option(std::string("merge_shards"), command::handle_merge_shards);
     
     command::add_command_option(std::string("add_library"), command::handle_add_library);
     command::add_command_option(std::string("add_header_directory"), command::handle_add_header_directory);
     command::add_command_option(std::string("add_source_directory"), command::handle_add_source_directory);
     command::add_command_option(std::string("add_compile_flag"), command::handle_add_compile_flag);
+    command::add_command_option(std::string("set_hash_normalization"), command::handle_set_hash_normalization);
+    command::add_command_option(std::string("set_debug_info"), command::handle_set_debug_info);
+    command::add_command_option(std::string("set_direct_mode"), command::handle_set_direct_mode);
+    command::add_command_option(std::string("set_shard_costs"), command::handle_set_shard_costs);
     
     command::add_command_option(std::string("remove_library"), command::handle_remove_library);
     command::add_command_option(std::string("remove_header_directory"), command::handle_remove_header_directory);
@@ -1,3 +1,6 @@
+#include "history.hpp"
+#include "unit_manifest.hpp"
+
 #include <functional>
 #include <string>
 #include <map>
@@ -5,28 +8,73 @@
 #include <filesystem>
 #include <vector>
 #include <mutex>
+#include <set>
+
+class watcher;
 
 namespace command 
 {
+	// Everything a build needs, kept together so resident processes can reuse it between builds
+	struct project_state
+	{
+		std::filesystem::path project_root;
+		std::filesystem::path project_layout_path;
+		std::map<std::string, std::vector<std::string>> project_layout;
+		std::map<std::string, int> file_hashstamps;
+		std::map<std::string, unit_manifest::entry> unit_manifests;
+		std::vector<std::string> source_files;
+		bool sources_scanned = false;
+		// Files each unit was preprocessed from, used to work out which units a change touches
+		std::map<std::string, std::set<std::string>> unit_dependencies;
+		// Units known to be unchanged since they were last built, these skip preprocessing entirely
+		std::set<std::string> clean_units;
+		// Units whose last preprocess or compile failed, any change may be the fix so they never wait on a clean unit going dirty
+		std::set<std::string> failed_units;
+	};
+
+	struct build_options
+	{
+		// Restricts a build to shard_index of shard_count deterministic slices of the project's units
+		int shard_index = 1;
+		int shard_count = 1;
+		// Overrides for the layout's threads and linker, zero and empty keep the layout values
+		int threads = 0;
+		std::string linker = "";
+		bool record_history = true;
+	};
+
 	std::optional<std::filesystem::path> find_build_folder();
 
+	std::optional<project_state> load_project(std::string project_name);
+	void reload_project_layout(project_state& state);
+	history::record build_project(std::string project_name, project_state& state, build_options options = build_options());
+	bool apply_project_changes(project_state& state, const std::set<std::string>& changed_paths, bool overflowed);
+	void watch_project(watcher& project_watcher, const project_state& state);
+
 	void add_command_option(std::string command, std::function<void()> command_function);
 	void add_command_option(std::string command, std::function<void(std::string)> command_function);
 	void add_command_option(std::string command, std::function<void(std::string, std::string)> command_function);
+	void add_command_option(std::string command, std::function<void(std::string, std::string, std::string)> command_function);
 
 	void parse_commands(int argc, char* argv[]);
 
 	void handle_null_arg_command(std::string command);
 	void handle_help();
+	void handle_serve();
 
 	void handle_one_arg_command(std::string command, std::string arg);
 	void handle_init(std::string project_name);
 	void handle_info(std::string project_name);
 	void handle_reset(std::string project_name);
 	void handle_build(std::string project_name);
+	void handle_history(std::string project_name);
+	void handle_watch(std::string project_name);
+	void handle_tune(std::string project_name);
 
 	void handle_two_arg_command(std::string first_arg, std::string command, std::string second_arg);
 	void handle_run(std::string project_name, std::string args);
+	void handle_analyze(std::string project_name, std::string report);
+	void handle_watch_and_run(std::string project_name, std::string args);
 	void handle_debug(std::string project_name, std::string args);
 	void handle_copy_to(std::string existing_project, std::string new_project);
 	void handle_copy_from(std::string new_project, std::string existing_project);
@@ -35,8 +83,16 @@ namespace command
 	void handle_add_header_directory(std::string existing_project, std::string path);
 	void handle_add_source_directory(std::string existing_project, std::string path);
 	void handle_add_compile_flag(std::string existing_project, std::string flag);
+	void handle_set_hash_normalization(std::string existing_project, std::string mode);
+	void handle_set_debug_info(std::string existing_project, std::string mode);
+	void handle_set_direct_mode(std::string existing_project, std::string mode);
+	void handle_set_shard_costs(std::string existing_project, std::string path);
 	void handle_remove_library(std::string existing_project, std::string path);
 	void handle_remove_header_directory(std::string existing_project, std::string path);
 	void handle_remove_source_directory(std::string existing_project, std::string path);
 	void handle_remove_compile_flag(std::string existing_project, std::string flag);
+	void handle_merge_shards(std::string project_name, std::string bundle_directory);
+
+	void handle_option_command(std::string command, std::string arg, std::string option, std::string value);
+	void handle_build_with_option(std::string project_name, std::string option, std::string value);
 }
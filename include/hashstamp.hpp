@@ -6,8 +6,12 @@
 class hashstamp 
 {
     private :
+        static std::string checksum(const std::string& record);
     public :
+        // Includes every intact record journaled by builds that never got to write_to_file
         static std::map<std::string, int> read_from_file();
         // TODO can unpack as pair in for_each
         static int write_to_file(std::map<std::string, int> writeable);
-};
\ No newline at end of file
+        // Records a single finished unit straight away, so an interrupted build keeps the work it did
+        static int append_to_journal(std::string source_file, int hash);
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+class history
+{
+    public :
+        struct record
+        {
+            long long started = 0;
+            long long wall_ns = 0;
+            long long cpu_ns = 0;
+            long long scan_ns = 0;
+            long long link_ns = 0;
+            // Summed over every worker thread, so these can exceed the wall time of the build
+            long long hash_ns = 0;
+            long long compile_ns = 0;
+            int checked = 0;
+            int hashed = 0;
+            int compiled = 0;
+            int cache_hits = 0;
+            // Cache hits proven from the unit's manifest, without running the preprocessor
+            int direct_hits = 0;
+            long long preprocessed_bytes = 0;
+            // Largest single preprocessor, compiler or linker run of this build
+            long long peak_rss_kb = 0;
+            // Compile time of every unit rebuilt in this build, keyed by path relative to the project root
+            std::map<std::string, long long> unit_compile_ns;
+        };
+
+        static std::vector<record> read_from_file(std::string project_name);
+        static int append_to_file(std::string project_name, const record& appendable);
+};
@@ -0,0 +1,40 @@
+#include <filesystem>
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+class preprocessed
+{
+    public :
+        // A '# line "file" flags' marker emitted by the preprocessor
+        struct line_marker
+        {
+            long long line = 0;
+            std::string file;
+            bool enters = false;
+            bool returns = false;
+        };
+
+        struct header_cost
+        {
+            long long bytes = 0;
+            long long lines = 0;
+            // Bytes of the header plus everything it pulled in the first time it was included
+            long long inclusive_bytes = 0;
+            int includers = 0;
+            std::vector<std::string> chain;
+        };
+
+        static std::optional<line_marker> parse_line_marker(const std::string& line);
+        // Every real file named by a line marker, relative paths are resolved against the current directory
+        static std::set<std::string> included_files(const std::string& text);
+        static void attribute_includes(const std::string& text, std::map<std::string, header_cost>& costs);
+
+        // Modes are "raw" (unchanged), "paths" (line marker paths made relative to the project root, line
+        // numbers kept for debug info), "lines" (line markers and blank lines dropped) and "tokens" ("lines"
+        // plus whitespace that does not separate tokens dropped)
+        static bool is_normalization_mode(const std::string& mode);
+        static std::string normalize(const std::string& text, const std::string& mode, const std::filesystem::path& project_root);
+};
@@ -0,0 +1,13 @@
+#include <filesystem>
+#include <string>
+
+// Resident build daemon, keeps project state in memory and serves thin CLI clients over a Unix socket
+class server
+{
+    private :
+        static std::filesystem::path socket_path(std::filesystem::path chai_path);
+    public :
+        static int serve();
+        // Hands the command to a running daemon, returns false if the command has to run locally
+        static bool forward(int argc, char* argv[]);
+};
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <filesystem>
+#include <map>
+#include <string>
+
+// What a unit was last preprocessed from, lets a build prove a unit unchanged from the raw files alone
+class unit_manifest
+{
+    public :
+        struct entry
+        {
+            // Digest of the commands and normalization the unit was built with, any change invalidates the entry
+            size_t context = 0;
+            // The hashstamp the unit had when its inputs looked like this
+            int unit_hash = 0;
+            // Content hash of the source and every header it included, keyed like hashstamps
+            std::map<std::string, size_t> inputs;
+        };
+
+        static std::map<std::string, entry> read_from_file();
+        static int write_to_file(const std::map<std::string, entry>& writeable);
+};
@@ -0,0 +1,26 @@
+#include <filesystem>
+#include <map>
+#include <set>
+#include <string>
+
+// Thin wrapper around inotify that reports changed files by absolute path
+class watcher
+{
+    private :
+        int inotify_descriptor = -1;
+        std::map<int, std::filesystem::path> watched_directories;
+        bool read_events(std::set<std::string>& changed_paths);
+    public :
+        watcher();
+        ~watcher();
+        watcher(const watcher&) = delete;
+        watcher& operator=(const watcher&) = delete;
+
+        int file_descriptor() const;
+        void watch(const std::filesystem::path& directory);
+        void watch_recursive(const std::filesystem::path& directory);
+        // Drains whatever is queued without blocking, returns true if the kernel dropped events
+        bool collect_changes(std::set<std::string>& changed_paths);
+        // Blocks until something changes, then keeps collecting until nothing has changed for the debounce period
+        bool wait_for_changes(std::set<std::string>& changed_paths, int debounce_milliseconds);
+};
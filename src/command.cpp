@@ -2,6 +2,11 @@
 #include "../include/settings.hpp"
 #include "../include/timestamp.hpp"
 #include "../include/hashstamp.hpp"
+#include "../include/history.hpp"
+#include "../include/unit_manifest.hpp"
+#include "../include/preprocessed.hpp"
+#include "../include/watcher.hpp"
+#include "../include/server.hpp"
 
 #include <chrono>
 #include <filesystem>
@@ -12,6 +17,17 @@
 #include <fstream>
 #include <sstream>
 #include <thread>
+#include <future>
+#include <algorithm>
+#include <iomanip>
+
+#include <cerrno>
+#include <csignal>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 static const std::string compiler_key = "compiler";
 static const std::string debugger_key = "debugger";
@@ -23,10 +39,17 @@ static const std::string libraries_key = "libraries";
 static const std::string sources_key = "sources";
 static const std::string standard_key = "standard";
 static const std::string threads_key = "threads";
+static const std::string regression_threshold_key = "regression_threshold";
+static const std::string hash_normalization_key = "hash_normalization";
+static const std::string linker_key = "linker";
+static const std::string debug_info_key = "debug_info";
+static const std::string direct_mode_key = "direct_mode";
+static const std::string shard_costs_key = "shard_costs";
 
 static std::map<std::string, std::function<void()>> null_arg_function_map;
 static std::map<std::string, std::function<void(std::string)>> one_arg_function_map;
 static std::map<std::string, std::function<void(std::string, std::string)>> two_arg_function_map;
+static std::map<std::string, std::function<void(std::string, std::string, std::string)>> option_function_map;
 
 static std::string format_build_command(const std::string& format)
 {
@@ -125,53 +148,454 @@ static bool thread_safe_vector_pop(T& assignable, std::vector<T>& popable, std::
 	return true;
 }
 
-static void thread_task_build_object(int thread_num, std::vector<std::string>& source_files, std::map<std::string, int>& file_hashstamps, std::mutex& queue_lock, std::mutex& timestamp_lock, std::string& hash_build_format, std::string& object_build_format)
+static long long elapsed_nanoseconds(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+static double seconds(long long nanoseconds)
+{
+	return nanoseconds / 1000000000.0;
+}
+
+static long long median_nanoseconds(std::vector<long long> values)
+{
+	std::sort(values.begin(), values.end());
+	return values.at(values.size() / 2);
+}
+
+static long long cpu_nanoseconds()
+{
+	long long returnable = 0;
+	struct rusage usage;
+
+	// Compilers run as child processes, so they have to be counted alongside chai itself
+	for(int who : {RUSAGE_SELF, RUSAGE_CHILDREN})
+	{
+		getrusage(who, &usage);
+		returnable += (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000000LL;
+		returnable += (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1000LL;
+	}
+
+	return returnable;
+}
+
+// Runs a shell command the way system() does, and raises peak_rss_kb to the largest resident set of the command
+// or anything it started. RUSAGE_CHILDREN only ever grows, so a resident chai needs the figure per command.
+static int run_command(const std::string& command, long long& peak_rss_kb)
+{
+	pid_t child = fork();
+	if(child == 0)
+	{
+		execl("/bin/sh", "sh", "-c", command.c_str(), static_cast<char*>(nullptr));
+		_exit(127);
+	}
+	if(child < 0)
+	{
+		return -1;
+	}
+
+	int status = 0;
+	struct rusage usage;
+	while(wait4(child, &status, 0, &usage) < 0)
+	{
+		if(errno != EINTR)
+		{
+			return -1;
+		}
+	}
+
+	peak_rss_kb = std::max(peak_rss_kb, static_cast<long long>(usage.ru_maxrss));
+	return status;
+}
+
+static std::string layout_value(const std::map<std::string, std::vector<std::string>>& project_layout, const std::string& key, const std::string& fallback)
+{
+	// Layouts written by older versions of chai do not carry every key
+	if(project_layout.count(key) == 0 || project_layout.at(key).empty() || project_layout.at(key).at(0) == "")
+	{
+		return fallback;
+	}
+
+	return project_layout.at(key).at(0);
+}
+
+// The hash step preprocesses with every flag the object compile would see, so its output can be compiled
+// directly instead of running the preprocessor a second time
+static std::string make_hash_command_format(const std::map<std::string, std::vector<std::string>>& project_layout)
+{
+	return project_layout.at(compiler_key).at(0)
+			+ " "   + "-E" +
+			+ " "   + unpack_string_vector(project_layout.at(hash_flags_key)) +
+			+ " "   + unpack_string_vector(project_layout.at(object_flags_key)) +
+			+ " "   + unpack_string_vector(project_layout.at(headers_key), "-I") +
+			+ " "   + "-std=" + project_layout.at(standard_key).at(0) +
+			+ " "   + "{in_file} -o {out_file}";
+}
+
+// Compiles the preprocessed output of the hash step, line markers keep diagnostics and debug info pointing at the original sources
+static std::string make_object_command_format(const std::map<std::string, std::vector<std::string>>& project_layout, const std::filesystem::path& objects_path)
+{
+	std::string debug_info_string = "";
+	std::string directory_string = "";
+
+	// Split DWARF keeps debug info out of the objects, so the link only carries small skeletons. The .dwo is written
+	// into temp next to the object and named after the unit, compiling from inside temp with its path mapped away
+	// leaves the skeleton with './unit.dwo' and a comp_dir of '.', which holds wherever the objects end up.
+	if(layout_value(project_layout, debug_info_key, "default") == "split")
+	{
+		std::filesystem::path temp_path = std::filesystem::path(objects_path).append("temp");
+		directory_string = "cd " + temp_path.string() + " &&";
+		debug_info_string = "-g -gsplit-dwarf -gz -dumpdir ./ -dumpbase {dump_base} -fdebug-prefix-map=" + temp_path.string() + "=.";
+	}
+
+	return directory_string
+			+ " "   + project_layout.at(compiler_key).at(0)
+			+ " "   + unpack_string_vector(project_layout.at(object_flags_key)) +
+			+ " "   + "-fpreprocessed -c {in_file} -o {out_file}" +
+			+ " "   + debug_info_string +
+			+ " "   + "-std=" + project_layout.at(standard_key).at(0);
+}
+
+static std::string display_path(const std::string& path, const std::filesystem::path& project_root)
+{
+	std::filesystem::path relative = std::filesystem::path(path).lexically_relative(project_root);
+	if(relative.empty() || relative.begin()->string() == "..")
+	{
+		return path;
+	}
+
+	return relative.string();
+}
+
+static std::string json_string(const std::string& unescaped)
+{
+	std::ostringstream escaped;
+	escaped << "\"";
+	for(char character : unescaped)
+	{
+		switch(character)
+		{
+			case '"' : escaped << "\\\""; break;
+			case '\\' : escaped << "\\\\"; break;
+			case '\n' : escaped << "\\n"; break;
+			case '\t' : escaped << "\\t"; break;
+			default :
+				if(static_cast<unsigned char>(character) < 0x20)
+				{
+					escaped << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(character) << std::dec;
+				} else
+				{
+					escaped << character;
+				}
+		}
+	}
+	escaped << "\"";
+
+	return escaped.str();
+}
+
+// Units are keyed relative to the project root wherever state leaves the machine, so it survives a different checkout path
+static std::string unit_key(const std::string& source_file, const std::filesystem::path& project_root)
+{
+	std::filesystem::path relative = std::filesystem::path(source_file).lexically_relative(project_root);
+	if(relative.empty() || relative.begin()->string() == "..")
+	{
+		return source_file;
+	}
+
+	return relative.string();
+}
+
+// Shared by every worker of a build, so each header is read and hashed once however many units include it
+struct direct_mode_state
+{
+	bool enabled = true;
+	size_t context = 0;
+	std::filesystem::file_time_type build_started;
+	std::mutex memo_lock;
+	std::map<std::string, std::shared_future<std::optional<size_t>>> content_hashes;
+};
+
+// Files that changed after the build started may not match what the preprocessor saw, those never hash
+static std::optional<size_t> content_hash(const std::string& path, direct_mode_state& direct)
+{
+	std::promise<std::optional<size_t>> promise;
+	std::shared_future<std::optional<size_t>> future;
+	bool reader = false;
+
+	direct.memo_lock.lock();
+	if(direct.content_hashes.count(path) == 0)
+	{
+		future = promise.get_future().share();
+		direct.content_hashes.insert_or_assign(path, future);
+		reader = true;
+	} else
+	{
+		future = direct.content_hashes.at(path);
+	}
+	direct.memo_lock.unlock();
+
+	if(reader)
+	{
+		std::optional<size_t> hash = std::nullopt;
+		std::error_code error;
+		std::filesystem::file_time_type modified = std::filesystem::last_write_time(path, error);
+		std::ifstream stream(path, std::ios::binary);
+		if(!error && modified <= direct.build_started && stream)
+		{
+			std::ostringstream buffer;
+			buffer << stream.rdbuf();
+			hash = std::hash<std::string>{}(buffer.str());
+		}
+		promise.set_value(hash);
+	}
+
+	return future.get();
+}
+
+static std::optional<unit_manifest::entry> make_manifest(const std::set<std::string>& dependencies, int unit_hash, const std::filesystem::path& project_root, direct_mode_state& direct)
+{
+	unit_manifest::entry returnable;
+	returnable.context = direct.context;
+	returnable.unit_hash = unit_hash;
+
+	for(const std::string& dependency : dependencies)
+	{
+		std::optional<size_t> hash = content_hash(dependency, direct);
+		if(!hash.has_value())
+		{
+			return std::nullopt;
+		}
+		returnable.inputs.insert_or_assign(unit_key(dependency, project_root), hash.value());
+	}
+
+	return returnable;
+}
+
+// A manifest hit needs every input to still hash the same, one changed header and the unit is preprocessed
+static bool manifest_matches(const unit_manifest::entry& entry, const std::filesystem::path& project_root, direct_mode_state& direct, std::set<std::string>& dependencies)
+{
+	for(const auto& [input, hash] : entry.inputs)
+	{
+		std::string input_path = std::filesystem::path(input).is_absolute() ? input : std::filesystem::path(project_root).append(input).string();
+		std::optional<size_t> current_hash = content_hash(input_path, direct);
+		if(!current_hash.has_value() || current_hash.value() != hash)
+		{
+			return false;
+		}
+		dependencies.insert(input_path);
+	}
+
+	return true;
+}
+
+static void thread_task_analyze_includes(int thread_num, std::vector<std::string>& source_files, std::map<std::string, preprocessed::header_cost>& header_costs, long long& preprocessed_bytes, std::vector<std::string>& failed_units, std::mutex& queue_lock, std::mutex& cost_lock, const std::string& hash_build_format)
+{
+	std::string source_file;
+	std::ostringstream buffer;
+	std::fstream preprocessed_file;
+	std::filesystem::path temp_file = std::filesystem::absolute(std::filesystem::current_path()).append("analyze_temp").append("chai_temp_" + std::to_string(thread_num));
+
+	while(thread_safe_vector_pop<std::string>(source_file, source_files, queue_lock))
+	{
+		if(system(format_build_command(hash_build_format, std::filesystem::absolute(source_file).string(), temp_file.string()).c_str()) != 0)
+		{
+			// The preprocessor already reported why, a unit it could not read says nothing about its headers
+			std::filesystem::remove(temp_file);
+			cost_lock.lock();
+			failed_units.push_back(source_file);
+			cost_lock.unlock();
+			continue;
+		}
+
+		buffer.str("");
+		buffer.clear();
+		preprocessed_file.open(temp_file);
+		if(preprocessed_file)
+		{
+			buffer << preprocessed_file.rdbuf();
+		}
+		preprocessed_file.close();
+
+		cost_lock.lock();
+		preprocessed::attribute_includes(buffer.str(), header_costs);
+		preprocessed_bytes += buffer.str().size();
+		cost_lock.unlock();
+	}
+}
+
+static void thread_task_build_object(int thread_num, std::vector<std::string>& source_files, command::project_state& state, std::mutex& queue_lock, std::mutex& timestamp_lock, std::string& hash_build_format, std::string& object_build_format, const std::string& object_build_digest, const std::string& normalization_mode, direct_mode_state& direct, history::record& build_record)
 {
 	std::string source_file;
 	std::string hash_command;
 	std::string object_command;
+	std::string object_file;
+	std::string dwo_file;
 	std::string hashable;
 	std::string file_name = "";
 	std::ostringstream buffer;
 	std::fstream hash_file;
+	std::chrono::steady_clock::time_point phase_start;
+	long long hash_nanoseconds = 0;
+	long long compile_nanoseconds = 0;
+	std::map<std::string, int>& file_hashstamps = state.file_hashstamps;
+	std::string source_key;
+	long long peak_rss_kb = 0;
 
 	int hash = 0;
-	std::filesystem::path temp_file = std::filesystem::absolute(std::filesystem::current_path()).append("temp").append("chai_temp_" + std::to_string(thread_num));
+	std::filesystem::path temp_file = std::filesystem::absolute(std::filesystem::current_path()).append("temp").append("chai_temp_" + std::to_string(thread_num) + ".ii");
+	std::filesystem::path temp_object = std::filesystem::path(temp_file).replace_extension(".o");
+	std::filesystem::path temp_dwo;
+	// In split DWARF builds the .dwo is as much a build output as the object, a unit missing either has to be rebuilt
+	bool split_debug_info = object_build_format.find("{dump_base}") != std::string::npos;
+	auto outputs_exist = [&]() {
+		return std::filesystem::exists(object_file) && (!split_debug_info || std::filesystem::exists(dwo_file));
+	};
 	while(thread_safe_vector_pop<std::string>(source_file, source_files, queue_lock))
 	{						
 		file_name = std::filesystem::absolute(source_file).filename().string();
+		source_key = unit_key(source_file, state.project_root);
+		object_file = std::filesystem::absolute(std::filesystem::current_path()).append(file_name.substr(0, file_name.find(".")) + ".o").string();
+		dwo_file = std::filesystem::path(object_file).replace_extension(".dwo").string();
+		temp_dwo = std::filesystem::path(temp_file).replace_filename(std::filesystem::path(dwo_file).filename());
+
+		timestamp_lock.lock();
+		if(state.clean_units.count(source_file) && outputs_exist())
+		{
+			build_record.cache_hits++;
+			timestamp_lock.unlock();
+			continue;
+		}
+		timestamp_lock.unlock();
+
+		if(direct.enabled)
+		{
+			std::optional<unit_manifest::entry> entry = std::nullopt;
+			timestamp_lock.lock();
+			if(state.unit_manifests.count(source_key) && file_hashstamps.count(source_key)
+				&& state.unit_manifests.at(source_key).context == direct.context
+				&& state.unit_manifests.at(source_key).unit_hash == file_hashstamps.at(source_key))
+			{
+				entry = state.unit_manifests.at(source_key);
+			}
+			timestamp_lock.unlock();
+
+			std::set<std::string> dependencies;
+			phase_start = std::chrono::steady_clock::now();
+			bool direct_hit = entry.has_value() && outputs_exist() && manifest_matches(entry.value(), state.project_root, direct, dependencies);
+			hash_nanoseconds = elapsed_nanoseconds(phase_start);
+
+			timestamp_lock.lock();
+			build_record.hash_ns += hash_nanoseconds;
+			if(direct_hit)
+			{
+				build_record.cache_hits++;
+				build_record.direct_hits++;
+				state.unit_dependencies.insert_or_assign(source_file, dependencies);
+				state.clean_units.insert(source_file);
+				timestamp_lock.unlock();
+				continue;
+			}
+			timestamp_lock.unlock();
+		}
 					
-		// Compile to temp file
+		// Preprocess to temp file, this is both what gets hashed and what gets compiled
 		hash_command = format_build_command(hash_build_format, std::filesystem::absolute(source_file).string(), temp_file.string());
 		
-		system(hash_command.c_str());
+		phase_start = std::chrono::steady_clock::now();
+		if(run_command(hash_command, peak_rss_kb) != 0)
+		{
+			// The preprocessor already reported why, leave the old hashstamp so the unit is retried next build
+			std::filesystem::remove(temp_file);
+			timestamp_lock.lock();
+			state.failed_units.insert(source_file);
+			timestamp_lock.unlock();
+			continue;
+		}
 
+		hashable.clear();
 		hash_file.open(temp_file);
 		if(hash_file) 
 		{
+			buffer.str("");
 			buffer.clear();
 			buffer << hash_file.rdbuf();
 			hashable = buffer.str();
 		}
 		hash_file.close();
 
-		hash = std::hash<std::string>{}(hashable);
+		// The compile command is part of the digest, flags that leave the preprocessed output alone still change the object
+		hash = std::hash<std::string>{}(preprocessed::normalize(hashable, normalization_mode, state.project_root) + object_build_digest);
+		std::set<std::string> dependencies = preprocessed::included_files(hashable);
+		std::optional<unit_manifest::entry> manifest = direct.enabled ? make_manifest(dependencies, hash, state.project_root, direct) : std::nullopt;
+		hash_nanoseconds = elapsed_nanoseconds(phase_start);
+
 		timestamp_lock.lock();
-		if(!std::filesystem::exists(std::filesystem::absolute(std::filesystem::current_path()).append(file_name.substr(0, file_name.find(".")) + ".o")) 
-			|| file_hashstamps.count(source_file) == 0 
-			|| file_hashstamps.at(source_file) != hash)
+		build_record.hashed++;
+		build_record.hash_ns += hash_nanoseconds;
+		build_record.preprocessed_bytes += hashable.size();
+		if(!outputs_exist() 
+			|| file_hashstamps.count(source_key) == 0 
+			|| file_hashstamps.at(source_key) != hash)
 		{
 			timestamp_lock.unlock();
 			
-			object_command = format_build_command(object_build_format, "-c", source_file);
+			// Objects are compiled aside and moved into place whole, an interrupted compile never leaves a half written object behind
+			if(split_debug_info)
+			{
+				object_command = format_build_command(object_build_format, temp_file.string(), temp_object.string(), file_name.substr(0, file_name.find(".")));
+			} else
+			{
+				object_command = format_build_command(object_build_format, temp_file.string(), temp_object.string());
+				// A .dwo left over from a split DWARF build would otherwise linger next to an object that no longer uses it
+				std::filesystem::remove(dwo_file);
+			}
 
-			system(object_command.c_str());
+			phase_start = std::chrono::steady_clock::now();
+			if(run_command(object_command, peak_rss_kb) != 0)
+			{
+				std::filesystem::remove(temp_dwo);
+				timestamp_lock.lock();
+				state.failed_units.insert(source_file);
+				timestamp_lock.unlock();
+				continue;
+			}
+			compile_nanoseconds = elapsed_nanoseconds(phase_start);
+			if(split_debug_info)
+			{
+				// The old object goes first, whatever an interruption leaves behind is either a matching pair or no object at all
+				std::filesystem::remove(object_file);
+				std::filesystem::rename(temp_dwo, dwo_file);
+			}
+			std::filesystem::rename(temp_object, object_file);
 
 			timestamp_lock.lock();
-			file_hashstamps.insert_or_assign(source_file, hash);
+			file_hashstamps.insert_or_assign(source_key, hash);
+			hashstamp::append_to_journal(source_key, hash);
+			build_record.compiled++;
+			build_record.compile_ns += compile_nanoseconds;
+			build_record.unit_compile_ns.insert_or_assign(source_key, compile_nanoseconds);
+		} else
+		{
+			build_record.cache_hits++;
+		}
+		if(manifest.has_value())
+		{
+			state.unit_manifests.insert_or_assign(source_key, manifest.value());
+		} else
+		{
+			state.unit_manifests.erase(source_key);
 		}
+		state.unit_dependencies.insert_or_assign(source_file, dependencies);
+		state.clean_units.insert(source_file);
+		state.failed_units.erase(source_file);
 		timestamp_lock.unlock();
 	}
+
+	timestamp_lock.lock();
+	build_record.peak_rss_kb = std::max(build_record.peak_rss_kb, peak_rss_kb);
+	timestamp_lock.unlock();
 }
 
 std::optional<std::filesystem::path> command::find_build_folder()
@@ -212,8 +636,18 @@ void command::add_command_option(std::string command, std::function<void(std::st
     two_arg_function_map.insert(std::pair(command, command_function));
 }
 
+void command::add_command_option(std::string command, std::function<void(std::string, std::string, std::string)> command_function)
+{
+    option_function_map.insert(std::pair(command, command_function));
+}
+
 void command::parse_commands(int argc, char* argv[])
 {
+    if(server::forward(argc, argv))
+    {
+        return;
+    }
+
     switch(argc) 
     {
         case 2 : 
@@ -222,6 +656,8 @@ void command::parse_commands(int argc, char* argv[])
             return command::handle_one_arg_command(std::string(argv[1]), std::string(argv[2]));
         case 4 :
             return command::handle_two_arg_command(std::string(argv[1]), std::string(argv[2]), std::string(argv[3]));
+        case 5 :
+            return command::handle_option_command(std::string(argv[1]), std::string(argv[2]), std::string(argv[3]), std::string(argv[4]));
         default :
             std::cerr << "Incorrect number of arguments! Please use the 'chai help' command to view proper command formatting!" << std::endl;
             return;
@@ -243,6 +679,11 @@ void command::handle_null_arg_command(std::string command)
     return runnable();
 }
 
+void command::handle_serve()
+{
+    server::serve();
+}
+
 void command::handle_help()
 {
     std::cout << "Welcome to chai, a c++ project build tool!" << std::endl;
@@ -253,11 +694,19 @@ void command::handle_help()
     std::cout << "[x] info project_name" << std::endl;
     std::cout << "[x] reset project_name" << std::endl;
     std::cout << "[x] build project_name" << std::endl;
+    std::cout << "[x] build project_name --shard i/n" << std::endl;
     std::cout << "[ ] existing_project copy_to new_project" << std::endl;
     std::cout << "[ ] new_project copy_from existing_project" << std::endl;
     std::cout << "[x] run project_name args" << std::endl;
-    std::cout << "[ ] debug project_name args" << std::endl;
+    std::cout << "[x] project_name debug args" << std::endl;
     std::cout << "[ ] project_name rename new_name" << std::endl; 
+    std::cout << "[x] serve" << std::endl;
+    std::cout << "[x] project_name history" << std::endl;
+    std::cout << "[x] project_name watch" << std::endl;
+    std::cout << "[x] project_name tune" << std::endl;
+    std::cout << "[x] project_name watch run_args" << std::endl;
+    std::cout << "[x] project_name merge_shards bundle_directory" << std::endl;
+    std::cout << "[x] project_name analyze includes|includes_json" << std::endl;
     std::cout << "[x] project_name add_library path" << std::endl;
     std::cout << "[x] project_name add_source_directory path" << std::endl;
     std::cout << "[x] project_name add_header_directory path" << std::endl;
@@ -265,6 +714,10 @@ void command::handle_help()
     std::cout << "[ ] project_name set_standard standard" << std::endl;
     std::cout << "[ ] project_name set_compiler compiler" << std::endl;
     std::cout << "[ ] project_name set_debugger debugger" << std::endl;
+    std::cout << "[x] project_name set_hash_normalization raw|paths|lines|tokens" << std::endl;
+    std::cout << "[x] project_name set_debug_info default|split" << std::endl;
+    std::cout << "[x] project_name set_direct_mode on|off" << std::endl;
+    std::cout << "[x] project_name set_shard_costs path" << std::endl;
     std::cout << "[x] project_name remove_library path" << std::endl;
     std::cout << "[x] project_name remove_source_directory path" << std::endl; 
     std::cout << "[x] project_name remove_header_directory path" << std::endl;
@@ -283,6 +736,10 @@ void command::handle_one_arg_command(std::string command, std::string arg)
     if(one_arg_function_map.count(command))
     {
         runnable = one_arg_function_map.at(command);
+    } else if(one_arg_function_map.count(arg))
+    {
+        // Also accept the 'project_name command' ordering used by the two argument commands
+        return one_arg_function_map.at(arg)(command);
     }
     
     return runnable(arg);
@@ -364,118 +821,1281 @@ void command::handle_reset(std::string project_name)
     default_project_layout.insert(std::make_pair(sources_key, std::vector<std::string>()));
     default_project_layout.insert(std::make_pair(standard_key, std::vector<std::string>()));
 	default_project_layout.insert(std::make_pair(threads_key, std::vector<std::string>({"8"})));
+	default_project_layout.insert(std::make_pair(hash_normalization_key, std::vector<std::string>({"raw"})));
+	default_project_layout.insert(std::make_pair(linker_key, std::vector<std::string>({"default"})));
+	default_project_layout.insert(std::make_pair(debug_info_key, std::vector<std::string>({"default"})));
+	default_project_layout.insert(std::make_pair(direct_mode_key, std::vector<std::string>({"on"})));
 
     settings::write_to_file(default_project_layout, project_layout_path);
 }
 
-void command::handle_build(std::string project_name) 
+// Where the project's shard cost table lives, relative paths are taken from the project root so the table can be checked in
+static std::filesystem::path shard_costs_path(const command::project_state& state)
 {
-    std::optional<std::filesystem::path> chai_path = command::find_build_folder();
+    std::string path = layout_value(state.project_layout, shard_costs_key, "");
+    if(path == "")
+    {
+        return std::filesystem::path();
+    }
 
-    if(!chai_path.has_value())
+    return std::filesystem::path(path).is_absolute() ? std::filesystem::path(path) : std::filesystem::path(state.project_root).append(path);
+}
+
+static std::map<std::string, long long> read_shard_costs(const command::project_state& state)
+{
+    std::map<std::string, long long> returnable;
+    std::filesystem::path costs_path = shard_costs_path(state);
+    if(costs_path.empty() || !std::filesystem::exists(costs_path))
     {
-        std::cerr << "Cannot find build folder, consider creating a project with 'chai init project_name'!" << std::endl;
-        return;
+        return returnable;
     }
-    
-    std::filesystem::path project_layout_path = chai_path.value().append("projects/" + project_name + "/project_layout");
-    
-    std::map<std::string, std::vector<std::string>> project_layout = settings::read_from_file(project_layout_path);
-    std::map<std::string, std::chrono::nanoseconds> file_timestamps = timestamp::read_from_file();
-	std::map<std::string, int> file_hashstamps = hashstamp::read_from_file();
 
-    std::vector<std::string> source_files = find_all_files(project_layout.at(sources_key), std::vector<std::string>({".cpp"}));
-    
-	std::string compiler_string = project_layout.at(compiler_key).at(0);
-	std::string debugger_string = project_layout.at(debugger_key).at(0);
-    std::string header_file_string = unpack_string_vector(project_layout.at(headers_key), "-I");
-    std::string compiler_flags_string = unpack_string_vector(project_layout.at(compile_flags_key));
-    std::string hash_flags_string = unpack_string_vector(project_layout.at(hash_flags_key));
-    std::string object_flags_string = unpack_string_vector(project_layout.at(object_flags_key));
-    std::string library_string = unpack_string_vector(project_layout.at(libraries_key), "-l");
-    std::string standard_string = "-std=" + project_layout.at(standard_key).at(0);
-        
-    std::filesystem::current_path(project_layout_path.parent_path().append("build/objects/"));
-    
-    std::set<std::string> duplicate_checker;
+    for(const auto& [unit, value] : settings::read_from_file(costs_path))
+    {
+        try
+        {
+            returnable.insert_or_assign(unit, std::stoll(value.at(0)));
+        } catch(const std::exception&)
+        {
+            continue;
+        }
+    }
 
-	std::mutex queutex;
-	std::mutex hashtex;
-	
-	for(const std::string& file_name : source_files) 
-	{
-		if(!duplicate_checker.extract(std::filesystem::absolute(file_name).filename().string()))
-		{
-			duplicate_checker.insert(std::filesystem::absolute(file_name).filename().string());  
-		} else 
-		{
-			std::cerr << "Duplicate file detected!" << std::endl;
-			std::cerr << "This project has multiple files named \"" << std::filesystem::absolute(file_name).filename().string() << "\"" << std::endl; 
-			std::cerr << "Please rename one (or all) problematic files before rebuild" << std::endl;
-			return;
-		}
-	}
+    return returnable;
+}
 
-	std::filesystem::path temp_directory = std::filesystem::absolute(std::filesystem::current_path()).append("temp");
-	std::filesystem::create_directory(temp_directory);
-	std::vector<std::thread> active_threads;
-	std::string hash_command_format = compiler_string + " " + hash_flags_string + "{in_file} > {out_file}"; 
-	std::string object_command_format = compiler_string 
-										+ " "   + object_flags_string +
-										+ " "   + library_string +
-										+ " "   + header_file_string +
-										+ " "   + "{file}" +
-										+ " "   + standard_string;
+// Identifies the split itself, bundles cut from different cost tables cannot be merged
+static std::string partition_digest(const std::vector<std::string>& unit_keys, const std::map<std::string, long long>& costs)
+{
+    std::set<std::string> sorted_keys(unit_keys.begin(), unit_keys.end());
+    std::string digestable = "";
+    for(const std::string& unit : sorted_keys)
+    {
+        digestable += unit + "=" + (costs.count(unit) ? std::to_string(costs.at(unit)) : "") + "\n";
+    }
 
-	int max_threads = std::stoi(project_layout.at(threads_key).at(0).c_str());
-	
-    for(int i = 0; i < max_threads; i++)
+    return std::to_string(std::hash<std::string>{}(digestable));
+}
+
+// Greedy longest-first partition on the shard cost table. The table is a file every runner gets from the checkout or
+// an artifact, never local history, so all shards agree on the split. Without one every unit costs the same and the
+// split only depends on the unit names.
+static std::set<std::string> partition_units(std::vector<std::string> unit_keys, const std::map<std::string, long long>& costs, int shard_index, int shard_count)
+{
+    std::vector<long long> known_costs;
+    for(const std::string& unit : unit_keys)
     {
-		active_threads.push_back(std::thread(thread_task_build_object, i, std::ref(source_files), std::ref(file_hashstamps), std::ref(queutex), std::ref(hashtex), std::ref(hash_command_format), std::ref(object_command_format)));
+        if(costs.count(unit))
+        {
+            known_costs.push_back(costs.at(unit));
+        }
     }
 
-	for(std::thread& thread : active_threads)
-	{
-		thread.join();
-	}
-	
-	std::filesystem::remove_all(temp_directory);
+    // Units that have never been compiled are assumed to be typical
+    long long fallback_cost = known_costs.empty() ? 1 : median_nanoseconds(known_costs);
+    auto cost_of = [&](const std::string& unit) { return costs.count(unit) ? costs.at(unit) : fallback_cost; };
+
+    std::sort(unit_keys.begin(), unit_keys.end(), [&](const std::string& left, const std::string& right) {
+        return cost_of(left) != cost_of(right) ? cost_of(left) > cost_of(right) : left < right;
+    });
+
+    std::set<std::string> returnable;
+    std::vector<long long> shard_loads(shard_count, 0);
+    for(const std::string& unit : unit_keys)
+    {
+        size_t lightest = std::min_element(shard_loads.begin(), shard_loads.end()) - shard_loads.begin();
+        shard_loads.at(lightest) += cost_of(unit);
+        if(static_cast<int>(lightest) == shard_index - 1)
+        {
+            returnable.insert(unit);
+        }
+    }
+
+    return returnable;
+}
+
+// Returns the peak resident set of the link in kilobytes
+static long long link_project(const std::string& project_name, const command::project_state& state, const std::vector<std::string>& object_files, std::string linker = "")
+{
+    long long peak_rss_kb = 0;
+    const std::map<std::string, std::vector<std::string>>& project_layout = state.project_layout;
+
+    if(linker == "")
+    {
+        linker = layout_value(project_layout, linker_key, "default");
+    }
 
-    std::vector<std::string> object_files = find_all_files(std::vector<std::string>({std::filesystem::absolute(std::filesystem::current_path()).string()}), std::vector<std::string>({".o"}));
     std::string object_file_string = unpack_string_vector(object_files);
-    std::string exe_path_string = "-o " + project_layout_path.parent_path().append("build/executable/" + project_name).string();
+    std::filesystem::path exe_path = state.project_layout_path.parent_path().append("build/executable/" + project_name);
+    std::string exe_path_string = "-o " + exe_path.string();
+
+    // Split DWARF objects only carry skeletons, the index lets the debugger start without reading every .dwo
+    bool split_debug_info = layout_value(project_layout, debug_info_key, "default") == "split";
+    bool linker_indexes = linker == "gold" || linker == "lld" || linker == "mold";
+    std::string debug_info_string = "";
+    if(split_debug_info)
+    {
+        debug_info_string = std::string("-gz") + (linker_indexes ? " -Wl,--gdb-index" : "");
+    }
     
-	std::string compile_command_format = compiler_string 
-										+ " "   + compiler_flags_string +
+	std::string compile_command_format = project_layout.at(compiler_key).at(0) 
+										+ " "   + unpack_string_vector(project_layout.at(compile_flags_key)) +
 										+ " "   + exe_path_string + 
-										+ " "   + library_string +
-										+ " "   + header_file_string +
+										+ " "   + (linker == "default" ? "" : "-fuse-ld=" + linker) +
+										+ " "   + debug_info_string +
+										+ " "   + unpack_string_vector(project_layout.at(libraries_key), "-l") +
+										+ " "   + unpack_string_vector(project_layout.at(headers_key), "-I") +
 										+ " "   + "{file}" +
-										+ " "   + standard_string;
+										+ " "   + "-std=" + project_layout.at(standard_key).at(0);
 
     std::string final_command_string = format_build_command(compile_command_format, object_file_string); 
                                         
-    system(final_command_string.c_str());
-    
-    hashstamp::write_to_file(file_hashstamps);
-}
-
-void command::handle_two_arg_command(std::string first_arg, std::string command, std::string second_arg) 
-{
-    std::function<void(std::string, std::string)> runnable = [&](std::string, std::string) {
-        std::cerr << "The command \'" << first_arg << " " << command << " " << second_arg << "\' is not a supported command. Please run \'chai help\' for a list of supported commands!" << std::endl;
-        return;
-    }; 
-    
-    if(two_arg_function_map.count(command))
+    if(run_command(final_command_string, peak_rss_kb) == 0 && split_debug_info && !linker_indexes
+        && system("command -v gdb-add-index > /dev/null 2>&1") == 0)
     {
-        runnable = two_arg_function_map.at(command);
+        // bfd cannot write the index itself, gdb ships a script that adds it after the fact. The skeletons name their
+        // .dwo relative to the objects directory, so that is where gdb has to look from.
+        std::filesystem::path objects_path = state.project_layout_path.parent_path().append("build/objects");
+        std::string index_command = "cd \"" + objects_path.string() + "\" && gdb-add-index \"" + exe_path.string() + "\" > /dev/null";
+        if(system(index_command.c_str()) != 0)
+        {
+            std::cerr << "gdb-add-index failed on " << exe_path.string() << ", the debugger will have to index it on every start" << std::endl;
+        }
     }
-    
-    return runnable(first_arg, second_arg);
+
+    return peak_rss_kb;
 }
 
-void command::handle_run(std::string project_name, std::string args) 
+// Bundles are tarballs of the shard's objects plus a manifest in the project_layout format holding the full unit
+// list, the units this shard built and their hashstamps, all keyed relative to the project root
+static void export_shard_bundle(const std::string& project_name, const command::project_state& state, const std::set<std::string>& shard_keys, const std::map<std::string, long long>& shard_costs, const history::record& build_record, const command::build_options& options)
+{
+    std::filesystem::path build_path = state.project_layout_path.parent_path().append("build");
+    std::string bundle_name = project_name + "-shard-" + std::to_string(options.shard_index) + "-of-" + std::to_string(options.shard_count);
+    std::filesystem::path bundle_path = std::filesystem::path(build_path).append("shards/" + bundle_name);
+    std::filesystem::path tar_path = std::filesystem::path(build_path).append("shards/" + bundle_name + ".tar");
+
+    std::filesystem::remove_all(bundle_path);
+    std::filesystem::create_directories(std::filesystem::path(bundle_path).append("objects"));
+
+    std::map<std::string, std::vector<std::string>> manifest;
+    manifest.insert_or_assign("project", std::vector<std::string>({project_name}));
+    manifest.insert_or_assign("shard_index", std::vector<std::string>({std::to_string(options.shard_index)}));
+    manifest.insert_or_assign("shard_count", std::vector<std::string>({std::to_string(options.shard_count)}));
+    manifest.insert_or_assign("units", std::vector<std::string>());
+    manifest.insert_or_assign("built", std::vector<std::string>());
+
+    std::vector<std::string> unit_keys;
+    for(const std::string& source_file : state.source_files)
+    {
+        unit_keys.push_back(unit_key(source_file, state.project_root));
+    }
+    manifest.insert_or_assign("partition", std::vector<std::string>({partition_digest(unit_keys, shard_costs)}));
+
+    // Ships what this shard learned about its units, merge_shards folds it into the cost table for the next split
+    for(const std::string& source_key : shard_keys)
+    {
+        if(build_record.unit_compile_ns.count(source_key))
+        {
+            manifest.insert_or_assign("cost:" + source_key, std::vector<std::string>({std::to_string(build_record.unit_compile_ns.at(source_key))}));
+        } else if(shard_costs.count(source_key))
+        {
+            manifest.insert_or_assign("cost:" + source_key, std::vector<std::string>({std::to_string(shard_costs.at(source_key))}));
+        }
+    }
+
+    for(const std::string& source_file : state.source_files)
+    {
+        std::string source_key = unit_key(source_file, state.project_root);
+        manifest.at("units").push_back(source_key);
+
+        // Units that failed this time may still have an old object lying around, those must not be shipped
+        if(shard_keys.count(source_key) == 0 || state.clean_units.count(source_file) == 0 || state.file_hashstamps.count(source_key) == 0)
+        {
+            continue;
+        }
+
+        std::string file_name = std::filesystem::path(source_file).filename().string();
+        std::string object_name = file_name.substr(0, file_name.find(".")) + ".o";
+        std::filesystem::copy_file(std::filesystem::path(build_path).append("objects/" + object_name), std::filesystem::path(bundle_path).append("objects/" + object_name), std::filesystem::copy_options::overwrite_existing);
+
+        std::filesystem::path dwo_path = std::filesystem::path(build_path).append("objects/" + file_name.substr(0, file_name.find(".")) + ".dwo");
+        if(std::filesystem::exists(dwo_path))
+        {
+            std::filesystem::copy_file(dwo_path, std::filesystem::path(bundle_path).append("objects/" + dwo_path.filename().string()), std::filesystem::copy_options::overwrite_existing);
+        }
+
+        manifest.at("built").push_back(source_key);
+        manifest.insert_or_assign("hashstamp:" + source_key, std::vector<std::string>({std::to_string(state.file_hashstamps.at(source_key))}));
+    }
+
+    settings::write_to_file(manifest, std::filesystem::path(bundle_path).append("manifest"));
+
+    std::string tar_command = "tar -C \"" + bundle_path.string() + "\" -cf \"" + tar_path.string() + "\" .";
+    if(system(tar_command.c_str()) != 0)
+    {
+        std::cerr << "Unable to write shard bundle " << tar_path.string() << "!" << std::endl;
+        return;
+    }
+    std::filesystem::remove_all(bundle_path);
+
+    std::cout << "Shard " << options.shard_index << "/" << options.shard_count << " built " << manifest.at("built").size() << " of its " << shard_keys.size() << " units, bundle written to " << tar_path.string() << std::endl;
+}
+
+// Objects and split DWARF files of units that no longer exist would otherwise end up in the link
+static void prune_objects(const command::project_state& state)
+{
+    std::set<std::string> unit_stems;
+    for(const std::string& source_file : state.source_files)
+    {
+        std::string file_name = std::filesystem::path(source_file).filename().string();
+        unit_stems.insert(file_name.substr(0, file_name.find(".")));
+    }
+
+    std::filesystem::path objects_path = state.project_layout_path.parent_path().append("build/objects");
+    for(const std::string& object_file : find_all_files(std::vector<std::string>({objects_path.string()}), std::vector<std::string>({".o", ".dwo"})))
+    {
+        if(unit_stems.count(std::filesystem::path(object_file).stem().string()) == 0)
+        {
+            std::filesystem::remove(object_file);
+        }
+    }
+}
+
+static void scan_sources(command::project_state& state)
+{
+    if(state.sources_scanned)
+    {
+        return;
+    }
+
+    state.source_files.clear();
+    for(const std::string& source_file : find_all_files(state.project_layout.at(sources_key), std::vector<std::string>({".cpp"})))
+    {
+        state.source_files.push_back(std::filesystem::path(source_file).lexically_normal().string());
+    }
+    state.sources_scanned = true;
+
+    // A failed unit that has since been deleted has nothing left to fix
+    for(auto unit = state.failed_units.begin(); unit != state.failed_units.end(); )
+    {
+        unit = std::find(state.source_files.begin(), state.source_files.end(), *unit) == state.source_files.end() ? state.failed_units.erase(unit) : std::next(unit);
+    }
+}
+
+std::optional<command::project_state> command::load_project(std::string project_name)
+{
+    std::optional<std::filesystem::path> chai_path = command::find_build_folder();
+
+    if(!chai_path.has_value())
+    {
+        std::cerr << "Cannot find build folder, consider creating a project with 'chai init project_name'!" << std::endl;
+        return std::nullopt;
+    }
+    
+    command::project_state state;
+    state.project_root = chai_path.value().parent_path();
+    state.project_layout_path = chai_path.value().append("projects/" + project_name + "/project_layout");
+
+    if(!std::filesystem::exists(state.project_layout_path))
+    {
+        std::cerr << "There is no project named \'" << project_name << "\', consider creating it with 'chai init " << project_name << "'!" << std::endl;
+        return std::nullopt;
+    }
+
+    state.project_layout = settings::read_from_file(state.project_layout_path);
+    state.file_hashstamps = hashstamp::read_from_file();
+    state.unit_manifests = unit_manifest::read_from_file();
+
+    // Older versions keyed hashstamps by absolute path, carry those over instead of rebuilding everything
+    std::map<std::string, int> stored_hashstamps = state.file_hashstamps;
+    for(const auto& [source_file, hash] : stored_hashstamps)
+    {
+        std::string relative_key = unit_key(source_file, state.project_root);
+        if(relative_key != source_file && state.file_hashstamps.count(relative_key) == 0)
+        {
+            state.file_hashstamps.insert_or_assign(relative_key, hash);
+        }
+    }
+
+    return std::optional<command::project_state>(state);
+}
+
+void command::reload_project_layout(command::project_state& state)
+{
+    state.project_layout = settings::read_from_file(state.project_layout_path);
+    state.sources_scanned = false;
+    state.clean_units.clear();
+}
+
+bool command::apply_project_changes(command::project_state& state, const std::set<std::string>& changed_paths, bool overflowed)
+{
+    if(overflowed || changed_paths.count(state.project_layout_path.lexically_normal().string()))
+    {
+        command::reload_project_layout(state);
+        return true;
+    }
+
+    size_t clean_before = state.clean_units.size();
+    bool affected = false;
+    for(const std::string& changed_path : changed_paths)
+    {
+        // Dirty units stay dirty until they build, so a known source changing still warrants a build even if it was not clean
+        if(std::find(state.source_files.begin(), state.source_files.end(), changed_path) != state.source_files.end())
+        {
+            affected = true;
+        }
+
+        // Added, removed or renamed sources change the unit list itself
+        if(std::filesystem::path(changed_path).extension() == ".cpp"
+            && std::filesystem::exists(changed_path) != (std::find(state.source_files.begin(), state.source_files.end(), changed_path) != state.source_files.end()))
+        {
+            state.sources_scanned = false;
+        }
+
+        state.clean_units.erase(changed_path);
+        for(const auto& [unit, dependencies] : state.unit_dependencies)
+        {
+            if(dependencies.count(changed_path))
+            {
+                state.clean_units.erase(unit);
+                affected = true;
+            }
+        }
+    }
+
+    // A failed unit's fix may be a header it never got to record, such as one that was missing
+    return !state.sources_scanned || affected || !state.failed_units.empty() || state.clean_units.size() != clean_before;
+}
+
+void command::watch_project(watcher& project_watcher, const command::project_state& state)
+{
+    // Only the layout matters in the project folder, its build directory is chai's own output
+    project_watcher.watch(state.project_layout_path.parent_path());
+
+    for(const std::string& key : {sources_key, headers_key})
+    {
+        for(const std::string& directory : state.project_layout.at(key))
+        {
+            if(directory != "")
+            {
+                project_watcher.watch_recursive(directory);
+            }
+        }
+    }
+}
+
+history::record command::build_project(std::string project_name, command::project_state& state, command::build_options options)
+{
+    std::chrono::steady_clock::time_point build_start = std::chrono::steady_clock::now();
+    long long cpu_start = cpu_nanoseconds();
+    history::record build_record;
+    build_record.started = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+    std::map<std::string, std::vector<std::string>>& project_layout = state.project_layout;
+    std::filesystem::path project_layout_path = state.project_layout_path;
+
+    std::chrono::steady_clock::time_point phase_start = std::chrono::steady_clock::now();
+    scan_sources(state);
+    std::vector<std::string> source_files = state.source_files;
+
+    std::set<std::string> shard_keys;
+    std::map<std::string, long long> shard_costs;
+    if(options.shard_count > 1)
+    {
+        std::vector<std::string> unit_keys;
+        for(const std::string& source_file : source_files)
+        {
+            unit_keys.push_back(unit_key(source_file, state.project_root));
+        }
+        shard_costs = read_shard_costs(state);
+        shard_keys = partition_units(unit_keys, shard_costs, options.shard_index, options.shard_count);
+
+        source_files.erase(std::remove_if(source_files.begin(), source_files.end(), [&](const std::string& source_file) {
+            return shard_keys.count(unit_key(source_file, state.project_root)) == 0;
+        }), source_files.end());
+    }
+    build_record.scan_ns = elapsed_nanoseconds(phase_start);
+    build_record.checked = source_files.size();
+        
+    std::filesystem::current_path(project_layout_path.parent_path().append("build/objects/"));
+    
+    std::set<std::string> duplicate_checker;
+
+	std::mutex queutex;
+	std::mutex hashtex;
+	
+	for(const std::string& file_name : state.source_files) 
+	{
+		if(!duplicate_checker.extract(std::filesystem::absolute(file_name).filename().string()))
+		{
+			duplicate_checker.insert(std::filesystem::absolute(file_name).filename().string());  
+		} else 
+		{
+			std::cerr << "Duplicate file detected!" << std::endl;
+			std::cerr << "This project has multiple files named \"" << std::filesystem::absolute(file_name).filename().string() << "\"" << std::endl; 
+			std::cerr << "Please rename one (or all) problematic files before rebuild" << std::endl;
+			return build_record;
+		}
+	}
+
+	// Whatever an interrupted build left in temp is never trusted
+	std::filesystem::path temp_directory = std::filesystem::absolute(std::filesystem::current_path()).append("temp");
+	std::filesystem::remove_all(temp_directory);
+	std::filesystem::create_directory(temp_directory);
+	std::vector<std::thread> active_threads;
+	std::string hash_command_format = make_hash_command_format(project_layout);
+	std::string object_command_format = make_object_command_format(project_layout, std::filesystem::absolute(std::filesystem::current_path()));
+	// What goes into unit hashes, without the objects directory so every checkout of the project agrees on them
+	std::string object_command_digest = make_object_command_format(project_layout, std::filesystem::path());
+	std::string normalization_mode = layout_value(project_layout, hash_normalization_key, "raw");
+
+	if(!preprocessed::is_normalization_mode(normalization_mode))
+	{
+		std::cerr << "Unknown hash normalization \'" << normalization_mode << "\', hashing raw preprocessed output instead" << std::endl;
+		normalization_mode = "raw";
+	}
+
+	direct_mode_state direct;
+	direct.enabled = layout_value(project_layout, direct_mode_key, "on") == "on";
+	direct.context = std::hash<std::string>{}(hash_command_format + "\n" + object_command_digest + "\n" + normalization_mode);
+	direct.build_started = std::filesystem::file_time_type::clock::now();
+
+	int max_threads = options.threads > 0 ? options.threads : std::stoi(project_layout.at(threads_key).at(0).c_str());
+	
+    for(int i = 0; i < max_threads; i++)
+    {
+		active_threads.push_back(std::thread(thread_task_build_object, i, std::ref(source_files), std::ref(state), std::ref(queutex), std::ref(hashtex), std::ref(hash_command_format), std::ref(object_command_format), std::cref(object_command_digest), std::cref(normalization_mode), std::ref(direct), std::ref(build_record)));
+    }
+
+	for(std::thread& thread : active_threads)
+	{
+		thread.join();
+	}
+	
+	std::filesystem::remove_all(temp_directory);
+
+    phase_start = std::chrono::steady_clock::now();
+    if(options.shard_count > 1)
+    {
+        // A shard only contributes objects, merge_shards does the link once every shard is in
+        export_shard_bundle(project_name, state, shard_keys, shard_costs, build_record, options);
+    } else
+    {
+        prune_objects(state);
+        long long link_peak_rss_kb = link_project(project_name, state, find_all_files(std::vector<std::string>({std::filesystem::absolute(std::filesystem::current_path()).string()}), std::vector<std::string>({".o"})), options.linker);
+        build_record.peak_rss_kb = std::max(build_record.peak_rss_kb, link_peak_rss_kb);
+        build_record.link_ns = elapsed_nanoseconds(phase_start);
+    }
+    
+    // The hashstamp file is shared by every project, so only this project's units are written over what is on disk
+    std::map<std::string, int> merged_hashstamps = hashstamp::read_from_file();
+    for(const std::string& source_file : state.source_files)
+    {
+        std::string source_key = unit_key(source_file, state.project_root);
+        if(state.file_hashstamps.count(source_key))
+        {
+            merged_hashstamps.insert_or_assign(source_key, state.file_hashstamps.at(source_key));
+        }
+    }
+    hashstamp::write_to_file(merged_hashstamps);
+
+    if(direct.enabled)
+    {
+        std::map<std::string, unit_manifest::entry> merged_manifests = unit_manifest::read_from_file();
+        for(const std::string& source_file : state.source_files)
+        {
+            std::string source_key = unit_key(source_file, state.project_root);
+            if(state.unit_manifests.count(source_key))
+            {
+                merged_manifests.insert_or_assign(source_key, state.unit_manifests.at(source_key));
+            } else
+            {
+                merged_manifests.erase(source_key);
+            }
+        }
+        unit_manifest::write_to_file(merged_manifests);
+    }
+
+    build_record.wall_ns = elapsed_nanoseconds(build_start);
+    build_record.cpu_ns = cpu_nanoseconds() - cpu_start;
+    if(options.record_history)
+    {
+        history::append_to_file(project_name, build_record);
+    }
+
+    return build_record;
+}
+
+void command::handle_build(std::string project_name) 
+{
+    std::optional<command::project_state> state = command::load_project(project_name);
+
+    if(state.has_value())
+    {
+        command::build_project(project_name, state.value());
+    }
+}
+
+void command::handle_build_with_option(std::string project_name, std::string option, std::string value)
+{
+    command::build_options options;
+
+    if(option != "--shard")
+    {
+        std::cerr << "Unknown build option \'" << option << "\', the only supported option is --shard i/n!" << std::endl;
+        return;
+    }
+
+    try
+    {
+        size_t splitter = value.find("/");
+        options.shard_index = std::stoi(value.substr(0, splitter));
+        options.shard_count = std::stoi(value.substr(splitter + 1));
+    } catch(const std::exception&)
+    {
+        options.shard_count = 0;
+    }
+
+    if(options.shard_count < 1 || options.shard_index < 1 || options.shard_index > options.shard_count)
+    {
+        std::cerr << "Invalid shard \'" << value << "\', expected i/n with 1 <= i <= n!" << std::endl;
+        return;
+    }
+
+    std::optional<command::project_state> state = command::load_project(project_name);
+
+    if(state.has_value())
+    {
+        command::build_project(project_name, state.value(), options);
+    }
+}
+
+void command::handle_merge_shards(std::string project_name, std::string bundle_directory)
+{
+    std::optional<command::project_state> state = command::load_project(project_name);
+
+    if(!state.has_value())
+    {
+        return;
+    }
+
+    std::vector<std::filesystem::path> bundles;
+    if(std::filesystem::is_directory(bundle_directory))
+    {
+        for(const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(bundle_directory))
+        {
+            if(entry.is_regular_file() && entry.path().extension() == ".tar")
+            {
+                bundles.push_back(std::filesystem::absolute(entry.path()));
+            }
+        }
+    }
+    std::sort(bundles.begin(), bundles.end());
+
+    if(bundles.empty())
+    {
+        std::cerr << "No shard bundles (.tar) found in " << bundle_directory << "!" << std::endl;
+        return;
+    }
+
+    std::filesystem::path build_path = state.value().project_layout_path.parent_path().append("build");
+    std::filesystem::path objects_path = std::filesystem::path(build_path).append("objects");
+    std::filesystem::path extract_path = std::filesystem::path(build_path).append("shards/merge_temp");
+    std::filesystem::create_directories(objects_path);
+
+    std::set<std::string> expected_units;
+    std::set<std::string> built_units;
+    std::vector<std::string> object_files;
+    int shard_count = 0;
+    std::string partition = "";
+    std::map<std::string, long long> merged_costs;
+
+    for(const std::filesystem::path& bundle : bundles)
+    {
+        std::filesystem::remove_all(extract_path);
+        std::filesystem::create_directories(extract_path);
+
+        std::string tar_command = "tar -C \"" + extract_path.string() + "\" -xf \"" + bundle.string() + "\"";
+        std::filesystem::path manifest_path = std::filesystem::path(extract_path).append("manifest");
+        if(system(tar_command.c_str()) != 0 || !std::filesystem::exists(manifest_path))
+        {
+            std::cerr << bundle.string() << " is not a chai shard bundle!" << std::endl;
+            std::filesystem::remove_all(extract_path);
+            return;
+        }
+
+        std::map<std::string, std::vector<std::string>> manifest = settings::read_from_file(manifest_path);
+        int bundle_shard_count = std::stoi(layout_value(manifest, "shard_count", "0"));
+        if(layout_value(manifest, "project", "") != project_name || (shard_count != 0 && bundle_shard_count != shard_count))
+        {
+            std::cerr << bundle.string() << " belongs to a different project or shard count, refusing to merge it!" << std::endl;
+            std::filesystem::remove_all(extract_path);
+            return;
+        }
+        shard_count = bundle_shard_count;
+
+        if(partition != "" && layout_value(manifest, "partition", "") != partition)
+        {
+            std::cerr << bundle.string() << " was split with a different shard cost table than the other bundles, refusing to merge it!" << std::endl;
+            std::cerr << "Make sure every shard runs with the same " << shard_costs_key << " file" << std::endl;
+            std::filesystem::remove_all(extract_path);
+            return;
+        }
+        partition = layout_value(manifest, "partition", "");
+
+        for(const auto& [key, value] : manifest)
+        {
+            if(key.rfind("cost:", 0) == 0 && !value.empty() && value.at(0) != "")
+            {
+                merged_costs.insert_or_assign(key.substr(5), std::stoll(value.at(0)));
+            }
+        }
+
+        for(const std::string& unit : manifest.at("units"))
+        {
+            if(unit != "")
+            {
+                expected_units.insert(unit);
+            }
+        }
+
+        for(const std::string& unit : manifest.at("built"))
+        {
+            if(unit == "" || manifest.count("hashstamp:" + unit) == 0)
+            {
+                continue;
+            }
+
+            built_units.insert(unit);
+            state.value().file_hashstamps.insert_or_assign(unit, std::stoi(manifest.at("hashstamp:" + unit).at(0)));
+        }
+
+        for(const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(std::filesystem::path(extract_path).append("objects")))
+        {
+            std::filesystem::path object_path = std::filesystem::path(objects_path).append(entry.path().filename().string());
+            std::filesystem::copy_file(entry.path(), object_path, std::filesystem::copy_options::overwrite_existing);
+            if(object_path.extension() == ".o")
+            {
+                object_files.push_back(object_path.string());
+            }
+        }
+    }
+    std::filesystem::remove_all(extract_path);
+
+    std::vector<std::string> missing_units;
+    std::set_difference(expected_units.begin(), expected_units.end(), built_units.begin(), built_units.end(), std::back_inserter(missing_units));
+    if(!missing_units.empty())
+    {
+        std::cerr << "The bundles do not cover every unit of project " << project_name << ", missing: " << unpack_string_vector(missing_units) << std::endl;
+        std::cerr << "Make sure every shard finished without errors and ran with the same " << shard_costs_key << " table, rerun the shards that failed" << std::endl;
+        return;
+    }
+
+    std::map<std::string, int> merged_hashstamps = hashstamp::read_from_file();
+    for(const std::string& unit : built_units)
+    {
+        merged_hashstamps.insert_or_assign(unit, state.value().file_hashstamps.at(unit));
+    }
+    hashstamp::write_to_file(merged_hashstamps);
+
+    link_project(project_name, state.value(), object_files);
+
+    std::filesystem::path costs_path = shard_costs_path(state.value());
+    if(!costs_path.empty())
+    {
+        std::map<std::string, long long> shard_costs = read_shard_costs(state.value());
+        std::map<std::string, std::vector<std::string>> writeable;
+        for(const auto& [unit, nanoseconds] : merged_costs)
+        {
+            shard_costs.insert_or_assign(unit, nanoseconds);
+        }
+        for(const auto& [unit, nanoseconds] : shard_costs)
+        {
+            if(expected_units.count(unit))
+            {
+                writeable.insert_or_assign(unit, std::vector<std::string>({std::to_string(nanoseconds)}));
+            }
+        }
+        std::filesystem::create_directories(costs_path.parent_path());
+        settings::write_to_file(writeable, costs_path);
+        std::cout << "Updated the shard cost table " << costs_path.string() << ", hand it to the next shard runs to balance them" << std::endl;
+    }
+
+    std::cout << "Merged " << bundles.size() << " bundles covering " << built_units.size() << " units into project " << project_name << std::endl;
+}
+
+void command::handle_history(std::string project_name)
+{
+    std::optional<std::filesystem::path> chai_path = command::find_build_folder();
+
+    if(!chai_path.has_value())
+    {
+        std::cerr << "Cannot find build folder, consider creating a project with 'chai init project_name'!" << std::endl;
+        return;
+    }
+
+    std::filesystem::path project_layout_path = chai_path.value().append("projects/" + project_name + "/project_layout");
+    std::map<std::string, std::vector<std::string>> project_layout = settings::read_from_file(project_layout_path);
+    std::vector<history::record> records = history::read_from_file(project_name);
+
+    if(records.empty())
+    {
+        std::cout << "No builds have been recorded for project " << project_name << " yet." << std::endl;
+        return;
+    }
+
+    // Percentage a build or unit has to exceed its recent baseline by before it is flagged
+    double threshold = std::stod(layout_value(project_layout, regression_threshold_key, "25")) / 100.0;
+    const size_t baseline_window = 5;
+    const size_t shown_builds = 20;
+    // Differences below this are scheduling noise, not regressions
+    const long long noise_floor = 50000000;
+
+    std::cout << "Build history of project " << project_name << " (regression threshold " << threshold * 100 << "%): " << std::endl;
+    std::cout << std::fixed << std::setprecision(2);
+
+    size_t first_shown = records.size() > shown_builds ? records.size() - shown_builds : 0;
+    for(size_t i = first_shown; i < records.size(); i++)
+    {
+        const history::record& record = records.at(i);
+        std::time_t started = record.started;
+
+        std::cout << "  " << std::put_time(std::localtime(&started), "%Y-%m-%d %H:%M:%S")
+                  << "  wall " << seconds(record.wall_ns) << "s"
+                  << "  cpu " << seconds(record.cpu_ns) << "s"
+                  << "  scan " << seconds(record.scan_ns) << "s"
+                  << "  link " << seconds(record.link_ns) << "s"
+                  << "  worker hash " << seconds(record.hash_ns) << "s"
+                  << "  worker compile " << seconds(record.compile_ns) << "s"
+                  << "  units " << record.checked << "/" << record.hashed << "/" << record.compiled << "/" << record.cache_hits
+                  << "  direct " << record.direct_hits
+                  << "  preprocessed " << record.preprocessed_bytes / 1048576.0 << "MiB"
+                  << "  peak rss " << record.peak_rss_kb / 1024.0 << "MiB";
+
+        // Only builds that did the same amount of work make a fair baseline, a no-op build says nothing about a rebuild
+        std::vector<long long> baseline;
+        for(size_t j = i; j > 0 && baseline.size() < baseline_window; j--)
+        {
+            const history::record& previous = records.at(j - 1);
+            if(previous.checked == record.checked && previous.hashed == record.hashed && previous.compiled == record.compiled)
+            {
+                baseline.push_back(previous.wall_ns);
+            }
+        }
+
+        if(!baseline.empty())
+        {
+            long long median = median_nanoseconds(baseline);
+            if(median > 0 && record.wall_ns - median > noise_floor && record.wall_ns > median * (1.0 + threshold))
+            {
+                std::cout << "  <-- regressed " << (record.wall_ns - median) * 100.0 / median << "%";
+            }
+        }
+        std::cout << std::endl;
+    }
+    std::cout << "  (scan and link are wall time, worker times are summed over every worker thread, units are checked/hashed/compiled/cache hits," << std::endl;
+    std::cout << "   peak rss is the largest single preprocessor, compiler or linker run of the build)" << std::endl;
+
+    const history::record& latest = records.back();
+    bool found_regression = false;
+    for(const auto& [unit, nanoseconds] : latest.unit_compile_ns)
+    {
+        std::vector<long long> baseline;
+        for(size_t j = records.size() - 1; j > 0 && baseline.size() < baseline_window; j--)
+        {
+            if(records.at(j - 1).unit_compile_ns.count(unit))
+            {
+                baseline.push_back(records.at(j - 1).unit_compile_ns.at(unit));
+            }
+        }
+
+        if(baseline.empty())
+        {
+            continue;
+        }
+
+        long long median = median_nanoseconds(baseline);
+        if(nanoseconds - median > noise_floor && nanoseconds > median * (1.0 + threshold))
+        {
+            if(!found_regression)
+            {
+                std::cout << "Translation units that regressed in the latest build: " << std::endl;
+                found_regression = true;
+            }
+            std::cout << "  " << unit << ": " << seconds(median) << "s -> " << seconds(nanoseconds) << "s (+" << (nanoseconds - median) * 100.0 / median << "%)" << std::endl;
+        }
+    }
+}
+
+void command::handle_analyze(std::string project_name, std::string report)
+{
+    std::optional<std::filesystem::path> chai_path = command::find_build_folder();
+
+    if(!chai_path.has_value())
+    {
+        std::cerr << "Cannot find build folder, consider creating a project with 'chai init project_name'!" << std::endl;
+        return;
+    }
+
+    if(report != "includes" && report != "includes_json")
+    {
+        std::cerr << "Unknown analysis \'" << report << "\', supported analyses are \'includes\' and \'includes_json\'!" << std::endl;
+        return;
+    }
+
+    std::filesystem::path project_root = chai_path.value().parent_path();
+    std::filesystem::path project_layout_path = chai_path.value().append("projects/" + project_name + "/project_layout");
+    std::map<std::string, std::vector<std::string>> project_layout = settings::read_from_file(project_layout_path);
+
+    std::vector<std::string> source_files = find_all_files(project_layout.at(sources_key), std::vector<std::string>({".cpp"}));
+    size_t unit_count = source_files.size();
+
+    std::filesystem::current_path(project_layout_path.parent_path().append("build/objects/"));
+    std::filesystem::path temp_directory = std::filesystem::absolute(std::filesystem::current_path()).append("analyze_temp");
+    std::filesystem::create_directory(temp_directory);
+
+    std::map<std::string, preprocessed::header_cost> header_costs;
+    long long preprocessed_bytes = 0;
+    std::vector<std::string> failed_units;
+    std::string hash_command_format = make_hash_command_format(project_layout);
+    std::mutex queutex;
+    std::mutex costex;
+    std::vector<std::thread> active_threads;
+
+    int max_threads = std::stoi(project_layout.at(threads_key).at(0).c_str());
+    for(int i = 0; i < max_threads; i++)
+    {
+        active_threads.push_back(std::thread(thread_task_analyze_includes, i, std::ref(source_files), std::ref(header_costs), std::ref(preprocessed_bytes), std::ref(failed_units), std::ref(queutex), std::ref(costex), std::cref(hash_command_format)));
+    }
+
+    for(std::thread& thread : active_threads)
+    {
+        thread.join();
+    }
+
+    std::filesystem::remove_all(temp_directory);
+
+    if(!failed_units.empty())
+    {
+        std::sort(failed_units.begin(), failed_units.end());
+        std::cerr << failed_units.size() << " units failed to preprocess and were left out of the analysis:";
+        for(const std::string& failed_unit : failed_units)
+        {
+            std::cerr << " " << display_path(failed_unit, project_root);
+        }
+        std::cerr << std::endl;
+        unit_count -= failed_units.size();
+    }
+
+    // Headers are ranked by what cutting them would save: their bytes plus everything they drag in, times every unit that includes them
+    std::vector<std::pair<std::string, preprocessed::header_cost>> ranked(header_costs.begin(), header_costs.end());
+    std::sort(ranked.begin(), ranked.end(), [](const auto& left, const auto& right) {
+        return left.second.inclusive_bytes != right.second.inclusive_bytes ? left.second.inclusive_bytes > right.second.inclusive_bytes : left.first < right.first;
+    });
+
+    if(report == "includes_json")
+    {
+        std::cout << "{" << std::endl;
+        std::cout << "  \"project\": " << json_string(project_name) << "," << std::endl;
+        std::cout << "  \"units\": " << unit_count << "," << std::endl;
+        std::cout << "  \"preprocessed_bytes\": " << preprocessed_bytes << "," << std::endl;
+        std::cout << "  \"headers\": [";
+        for(size_t i = 0; i < ranked.size(); i++)
+        {
+            const auto& [header, cost] = ranked.at(i);
+            std::cout << (i == 0 ? "" : ",") << std::endl;
+            std::cout << "    {\"header\": " << json_string(display_path(header, project_root))
+                      << ", \"includers\": " << cost.includers
+                      << ", \"bytes\": " << cost.bytes
+                      << ", \"lines\": " << cost.lines
+                      << ", \"inclusive_bytes\": " << cost.inclusive_bytes
+                      << ", \"chain\": [";
+            for(size_t j = 0; j < cost.chain.size(); j++)
+            {
+                std::cout << (j == 0 ? "" : ", ") << json_string(display_path(cost.chain.at(j), project_root));
+            }
+            std::cout << "]}";
+        }
+        std::cout << std::endl << "  ]" << std::endl << "}" << std::endl;
+        return;
+    }
+
+    const size_t shown_headers = 25;
+
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "Most expensive headers of project " << project_name << " (" << unit_count << " units, " << preprocessed_bytes / 1048576.0 << "MiB preprocessed): " << std::endl;
+    for(size_t i = 0; i < ranked.size() && i < shown_headers; i++)
+    {
+        const auto& [header, cost] = ranked.at(i);
+        std::cout << "  " << display_path(header, project_root) << std::endl;
+        std::cout << "    total " << cost.inclusive_bytes / 1048576.0 << "MiB"
+                  << "  own " << cost.bytes / 1048576.0 << "MiB (" << cost.lines << " lines)"
+                  << "  included by " << cost.includers << " units"
+                  << "  " << cost.inclusive_bytes / 1024.0 / cost.includers << "KiB per include" << std::endl;
+
+        std::cout << "    via ";
+        for(size_t j = 0; j < cost.chain.size(); j++)
+        {
+            std::cout << (j == 0 ? "" : " -> ") << display_path(cost.chain.at(j), project_root);
+        }
+        std::cout << std::endl;
+    }
+}
+
+static pid_t start_executable(const std::filesystem::path& exe_path, const std::string& args)
+{
+    std::string command_string = "exec " + exe_path.string() + " " + args;
+
+    pid_t child = fork();
+    if(child == 0)
+    {
+        execl("/bin/sh", "sh", "-c", command_string.c_str(), static_cast<char*>(nullptr));
+        _exit(127);
+    }
+
+    return child;
+}
+
+static void stop_executable(pid_t& running)
+{
+    if(running <= 0)
+    {
+        return;
+    }
+
+    // Give the program a couple of seconds to shut down cleanly before it is killed outright
+    kill(running, SIGTERM);
+    for(int i = 0; i < 20 && waitpid(running, nullptr, WNOHANG) == 0; i++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    if(waitpid(running, nullptr, WNOHANG) == 0)
+    {
+        kill(running, SIGKILL);
+        waitpid(running, nullptr, 0);
+    }
+
+    running = -1;
+}
+
+static void watch_project_loop(std::string project_name, std::optional<std::string> run_args)
+{
+    std::optional<command::project_state> state = command::load_project(project_name);
+
+    if(!state.has_value())
+    {
+        return;
+    }
+
+    watcher project_watcher;
+    if(project_watcher.file_descriptor() < 0)
+    {
+        return;
+    }
+
+    std::filesystem::path project_root = state.value().project_root;
+    std::filesystem::path exe_path = state.value().project_layout_path.parent_path().append("build/executable/" + project_name);
+    std::filesystem::current_path(project_root);
+    command::watch_project(project_watcher, state.value());
+
+    const int debounce_milliseconds = 150;
+    pid_t running = -1;
+    while(true)
+    {
+        stop_executable(running);
+        command::build_project(project_name, state.value());
+        std::filesystem::current_path(project_root);
+
+        if(run_args.has_value() && std::filesystem::exists(exe_path))
+        {
+            running = start_executable(exe_path, run_args.value());
+        }
+
+        std::cout << "Watching project " << project_name << " for changes, press Ctrl-C to stop" << std::endl;
+
+        bool rebuild = false;
+        while(!rebuild)
+        {
+            std::set<std::string> changed_paths;
+            bool overflowed = project_watcher.wait_for_changes(changed_paths, debounce_milliseconds);
+            rebuild = command::apply_project_changes(state.value(), changed_paths, overflowed);
+        }
+
+        if(!state.value().sources_scanned)
+        {
+            command::watch_project(project_watcher, state.value());
+        }
+    }
+}
+
+struct tune_measurement
+{
+    std::string kind;
+    int threads = 0;
+    std::string linker;
+    history::record record;
+};
+
+// Builds in a forked child so every measurement, peak memory in particular, covers exactly one build
+static std::optional<history::record> measure_build(const std::string& project_name, command::project_state& state, const command::build_options& options)
+{
+    int result_pipe[2];
+    if(pipe(result_pipe) != 0)
+    {
+        return std::nullopt;
+    }
+
+    std::cout.flush();
+    std::cerr.flush();
+    pid_t child = fork();
+    if(child == 0)
+    {
+        close(result_pipe[0]);
+        int null_descriptor = open("/dev/null", O_WRONLY);
+        dup2(null_descriptor, STDOUT_FILENO);
+
+        history::record record = command::build_project(project_name, state, options);
+        std::string result = std::to_string(record.wall_ns) + " " + std::to_string(record.cpu_ns) + " " + std::to_string(record.link_ns) + " "
+                           + std::to_string(record.peak_rss_kb) + " " + std::to_string(record.compiled) + "\n";
+        // The result fits well inside the pipe buffer, a short write means the parent is gone or the pipe broke
+        bool written = write(result_pipe[1], result.data(), result.size()) == static_cast<ssize_t>(result.size());
+        _exit(written ? 0 : 1);
+    }
+    close(result_pipe[1]);
+
+    std::string result;
+    char buffer[256];
+    ssize_t length = 0;
+    while((length = read(result_pipe[0], buffer, sizeof(buffer))) > 0)
+    {
+        result.append(buffer, length);
+    }
+    close(result_pipe[0]);
+    int status = 0;
+    waitpid(child, &status, 0);
+
+    history::record record;
+    std::istringstream fields(result);
+    if(!WIFEXITED(status) || WEXITSTATUS(status) != 0 || !(fields >> record.wall_ns >> record.cpu_ns >> record.link_ns >> record.peak_rss_kb >> record.compiled))
+    {
+        return std::nullopt;
+    }
+
+    return std::optional<history::record>(record);
+}
+
+static long long available_memory_kilobytes()
+{
+    std::ifstream meminfo("/proc/meminfo");
+    std::string key;
+    long long value = 0;
+    std::string unit;
+
+    while(meminfo >> key >> value >> unit)
+    {
+        if(key == "MemAvailable:")
+        {
+            return value;
+        }
+    }
+
+    return 0;
+}
+
+void command::handle_tune(std::string project_name)
+{
+    std::optional<command::project_state> state = command::load_project(project_name);
+
+    if(!state.has_value())
+    {
+        return;
+    }
+
+    std::filesystem::path project_root = state.value().project_root;
+    std::filesystem::path objects_path = state.value().project_layout_path.parent_path().append("build/objects");
+    std::string compiler_string = state.value().project_layout.at(compiler_key).at(0);
+
+    // Spread worker counts around the core count, a little past it too since compiles also wait on disk
+    int hardware_threads = std::max(1u, std::thread::hardware_concurrency());
+    std::set<int> thread_candidates;
+    for(int candidate : {hardware_threads / 8, hardware_threads / 4, hardware_threads / 2, hardware_threads * 3 / 4, hardware_threads, hardware_threads * 3 / 2})
+    {
+        thread_candidates.insert(std::max(1, candidate));
+    }
+
+    std::vector<std::string> linker_candidates({"default"});
+    for(const std::string& linker : std::vector<std::string>({"bfd", "gold", "lld", "mold"}))
+    {
+        std::string probe = "echo 'int main(){}' | " + compiler_string + " -fuse-ld=" + linker + " -x c++ - -o /dev/null > /dev/null 2>&1";
+        if(system(probe.c_str()) == 0)
+        {
+            linker_candidates.push_back(linker);
+        }
+    }
+
+    std::cout << "Tuning project " << project_name << " on " << hardware_threads << " hardware threads, worker counts:";
+    for(int threads : thread_candidates)
+    {
+        std::cout << " " << threads;
+    }
+    std::cout << ", linkers: " << unpack_string_vector(linker_candidates) << std::endl;
+
+    std::vector<tune_measurement> measurements;
+    auto run_measurement = [&](const std::string& kind, int threads, const std::string& linker) -> std::optional<history::record> {
+        state.value().file_hashstamps = hashstamp::read_from_file();
+        if(kind == "cold")
+        {
+            state.value().file_hashstamps.clear();
+            for(const std::string& object_file : find_all_files(std::vector<std::string>({objects_path.string()}), std::vector<std::string>({".o", ".dwo"})))
+            {
+                std::filesystem::remove(object_file);
+            }
+        } else if(!state.value().source_files.empty())
+        {
+            // An incremental build is every unit checked and the first one recompiled
+            state.value().file_hashstamps.erase(unit_key(state.value().source_files.front(), project_root));
+        }
+
+        command::build_options options;
+        options.threads = threads;
+        options.linker = linker;
+        options.record_history = false;
+
+        std::optional<history::record> record = measure_build(project_name, state.value(), options);
+        std::filesystem::current_path(project_root);
+        if(record.has_value())
+        {
+            measurements.push_back(tune_measurement{kind, threads, linker, record.value()});
+            std::cout << std::fixed << std::setprecision(2)
+                      << "  " << kind << " build, " << threads << " workers, " << linker << " linker: wall " << seconds(record.value().wall_ns) << "s"
+                      << "  cpu utilization " << 100.0 * record.value().cpu_ns / std::max(1LL, record.value().wall_ns) / hardware_threads << "%"
+                      << "  link " << seconds(record.value().link_ns) << "s"
+                      << "  peak rss " << record.value().peak_rss_kb / 1024.0 << "MiB" << std::endl;
+        }
+        return record;
+    };
+
+    // Scan once up front and warm the file cache so every measured build does the same work
+    scan_sources(state.value());
+    run_measurement("incremental", *thread_candidates.rbegin(), "default");
+    measurements.clear();
+
+    long long memory_budget = available_memory_kilobytes() * 8 / 10;
+    std::optional<std::pair<int, long long>> best_threads;
+    long long fastest_wall = 0;
+    std::map<int, long long> cold_walls;
+    for(int threads : thread_candidates)
+    {
+        std::optional<history::record> record = run_measurement("cold", threads, "default");
+        if(!record.has_value())
+        {
+            continue;
+        }
+
+        // Worker counts that would push the machine into swap are not worth their speed
+        if(memory_budget > 0 && record.value().peak_rss_kb * threads > memory_budget)
+        {
+            std::cout << "    skipped, " << threads << " compilers at this peak would not fit in available memory" << std::endl;
+            continue;
+        }
+        cold_walls.insert_or_assign(threads, record.value().wall_ns);
+        fastest_wall = fastest_wall == 0 ? record.value().wall_ns : std::min(fastest_wall, record.value().wall_ns);
+    }
+
+    // The fewest workers within 5% of the fastest, extra workers past that only cost memory
+    for(const auto& [threads, wall] : cold_walls)
+    {
+        if(!best_threads.has_value() && wall <= fastest_wall * 1.05)
+        {
+            best_threads = std::make_pair(threads, wall);
+        }
+    }
+
+    if(!best_threads.has_value())
+    {
+        std::cerr << "No tuning build succeeded, the project layout was left unchanged!" << std::endl;
+        return;
+    }
+
+    std::string best_linker = "default";
+    long long best_link = 0;
+    for(const std::string& linker : linker_candidates)
+    {
+        std::optional<history::record> record = run_measurement("incremental", best_threads.value().first, linker);
+        if(record.has_value() && (best_link == 0 || record.value().link_ns < best_link))
+        {
+            best_linker = linker;
+            best_link = record.value().link_ns;
+        }
+    }
+
+    std::map<std::string, std::vector<std::string>> project_layout = settings::read_from_file(state.value().project_layout_path);
+    project_layout.insert_or_assign(threads_key, std::vector<std::string>({std::to_string(best_threads.value().first)}));
+    project_layout.insert_or_assign(linker_key, std::vector<std::string>({best_linker}));
+    settings::write_to_file(project_layout, state.value().project_layout_path);
+
+    // The last measurement linked with whichever linker was probed last, the executable on disk has to match the layout
+    command::reload_project_layout(state.value());
+    link_project(project_name, state.value(), find_all_files(std::vector<std::string>({objects_path.string()}), std::vector<std::string>({".o"})), best_linker);
+
+    std::filesystem::path report_path = std::filesystem::path(project_root).append(".chai/cache/" + project_name + ".tune");
+    std::ofstream report(report_path);
+    report << "hardware_threads=" << hardware_threads << std::endl;
+    for(const tune_measurement& measurement : measurements)
+    {
+        report << "kind=" << measurement.kind << "\tthreads=" << measurement.threads << "\tlinker=" << measurement.linker
+               << "\twall=" << measurement.record.wall_ns << "\tcpu=" << measurement.record.cpu_ns
+               << "\tlink=" << measurement.record.link_ns << "\tpeak_rss=" << measurement.record.peak_rss_kb << std::endl;
+    }
+    report << "chosen_threads=" << best_threads.value().first << "\tchosen_linker=" << best_linker << std::endl;
+    report.close();
+
+    std::cout << "Wrote threads=" << best_threads.value().first << " and linker=" << best_linker << " to the layout of project " << project_name
+              << ", measurements are in " << report_path.string() << std::endl;
+}
+
+void command::handle_watch(std::string project_name)
+{
+    watch_project_loop(project_name, std::nullopt);
+}
+
+void command::handle_watch_and_run(std::string project_name, std::string args)
+{
+    watch_project_loop(project_name, std::optional<std::string>(args));
+}
+
+void command::handle_option_command(std::string command, std::string arg, std::string option, std::string value)
+{
+    std::function<void(std::string, std::string, std::string)> runnable = [&](std::string, std::string, std::string) {
+        std::cerr << "The command \'" << command << " " << arg << " " << option << " " << value << "\' is not a supported command. Please run \'chai help\' for a list of supported commands!" << std::endl;
+        return;
+    };
+
+    if(option_function_map.count(command))
+    {
+        runnable = option_function_map.at(command);
+    }
+
+    return runnable(arg, option, value);
+}
+
+void command::handle_two_arg_command(std::string first_arg, std::string command, std::string second_arg) 
+{
+    std::function<void(std::string, std::string)> runnable = [&](std::string, std::string) {
+        std::cerr << "The command \'" << first_arg << " " << command << " " << second_arg << "\' is not a supported command. Please run \'chai help\' for a list of supported commands!" << std::endl;
+        return;
+    }; 
+    
+    if(two_arg_function_map.count(command))
+    {
+        runnable = two_arg_function_map.at(command);
+    }
+    
+    return runnable(first_arg, second_arg);
+}
+
+void command::handle_run(std::string project_name, std::string args) 
 {
     std::optional<std::filesystem::path> chai_path = command::find_build_folder();
 
@@ -492,8 +2112,80 @@ void command::handle_run(std::string project_name, std::string args)
     system(final_command.c_str());
 }
 
-// TODO this.
-void command::handle_debug(std::string project_name, std::string args) {}
+// gdb's own separate debug info search path, so adding the objects directory does not hide system debug info
+static std::string gdb_debug_file_directory(const std::string& debugger)
+{
+    std::string returnable = "/usr/lib/debug";
+    std::string query = debugger + " -nx -batch -ex \"show debug-file-directory\" 2> /dev/null";
+
+    FILE* output = popen(query.c_str(), "r");
+    if(output == nullptr)
+    {
+        return returnable;
+    }
+
+    std::string answer;
+    char buffer[256];
+    while(std::fgets(buffer, sizeof(buffer), output) != nullptr)
+    {
+        answer += buffer;
+    }
+    pclose(output);
+
+    // 'The directory where separate debug symbols are searched for is "/usr/lib/debug".'
+    size_t open = answer.find('"');
+    size_t close = answer.rfind('"');
+    if(open != std::string::npos && close > open + 1)
+    {
+        returnable = answer.substr(open + 1, close - open - 1);
+    }
+
+    return returnable;
+}
+
+void command::handle_debug(std::string project_name, std::string args)
+{
+    std::optional<std::filesystem::path> chai_path = command::find_build_folder();
+
+    if(!chai_path.has_value())
+    {
+        std::cerr << "Cannot find build folder, consider creating a project with 'chai init project_name'!" << std::endl;
+        return;
+    }
+
+    std::filesystem::path project_path = chai_path.value().append("projects/" + project_name);
+    std::filesystem::path exe_path = std::filesystem::path(project_path).append("build/executable/" + project_name);
+
+    if(!std::filesystem::exists(exe_path))
+    {
+        std::cerr << "Project " << project_name << " has no executable yet, build it with 'chai build " << project_name << "' first!" << std::endl;
+        return;
+    }
+
+    std::map<std::string, std::vector<std::string>> project_layout = settings::read_from_file(std::filesystem::path(project_path).append("project_layout"));
+    std::string debugger = layout_value(project_layout, debugger_key, "gdb");
+
+    // Split DWARF skeletons name their .dwo relative to the objects directory, the debugger is pointed there without
+    // touching the program's working directory
+    std::string objects_path = std::filesystem::path(project_path).append("build/objects").string();
+
+    // Every debugger spells "the rest are the program's arguments" differently
+    std::string final_command = debugger + " " + exe_path.string() + " " + args;
+    if(std::filesystem::path(debugger).filename() == "gdb")
+    {
+        final_command = debugger + " -iex \"set debug-file-directory " + objects_path + ":" + gdb_debug_file_directory(debugger) + "\""
+                      + " --args " + exe_path.string() + " " + args;
+    } else if(std::filesystem::path(debugger).filename() == "lldb")
+    {
+        final_command = debugger + " -O \"settings append target.debug-file-search-paths " + objects_path + "\""
+                      + " -- " + exe_path.string() + " " + args;
+    }
+
+    if(system(final_command.c_str()) != 0 && system(("command -v " + debugger + " > /dev/null 2>&1").c_str()) != 0)
+    {
+        std::cerr << "Unable to find debugger \'" << debugger << "\', change the debugger in the layout of project " << project_name << "!" << std::endl;
+    }
+}
 // TODO also this.
 void command::handle_copy_to(std::string existing_project, std::string new_project) {}
 // TODO this too.
@@ -551,6 +2243,98 @@ void command::handle_add_compile_flag(std::string existing_project, std::string
     settings::write_to_file(settings, project_layout_path);
 }
 
+void command::handle_set_hash_normalization(std::string existing_project, std::string mode)
+{
+    std::optional<std::filesystem::path> chai_path = command::find_build_folder();
+    
+    if(!chai_path.has_value())
+    {
+        std::cerr << "Cannot find build folder, consider creating a project with 'chai init project_name'!" << std::endl;
+        return;
+    }
+
+    if(!preprocessed::is_normalization_mode(mode))
+    {
+        std::cerr << "Unknown hash normalization \'" << mode << "\', supported modes are raw, paths, lines and tokens!" << std::endl;
+        return;
+    }
+    
+    std::filesystem::path project_layout_path = chai_path.value().append("projects/" + existing_project + "/project_layout");
+    std::map<std::string, std::vector<std::string>> settings = settings::read_from_file(project_layout_path);
+    
+    settings.insert_or_assign(hash_normalization_key, std::vector<std::string>({mode}));
+    
+    settings::write_to_file(settings, project_layout_path);
+}
+
+void command::handle_set_debug_info(std::string existing_project, std::string mode)
+{
+    std::optional<std::filesystem::path> chai_path = command::find_build_folder();
+    
+    if(!chai_path.has_value())
+    {
+        std::cerr << "Cannot find build folder, consider creating a project with 'chai init project_name'!" << std::endl;
+        return;
+    }
+
+    if(mode != "default" && mode != "split")
+    {
+        std::cerr << "Unknown debug info mode \'" << mode << "\', supported modes are default and split!" << std::endl;
+        return;
+    }
+    
+    std::filesystem::path project_layout_path = chai_path.value().append("projects/" + existing_project + "/project_layout");
+    std::map<std::string, std::vector<std::string>> settings = settings::read_from_file(project_layout_path);
+    
+    settings.insert_or_assign(debug_info_key, std::vector<std::string>({mode}));
+    
+    settings::write_to_file(settings, project_layout_path);
+}
+
+void command::handle_set_direct_mode(std::string existing_project, std::string mode)
+{
+    std::optional<std::filesystem::path> chai_path = command::find_build_folder();
+    
+    if(!chai_path.has_value())
+    {
+        std::cerr << "Cannot find build folder, consider creating a project with 'chai init project_name'!" << std::endl;
+        return;
+    }
+
+    if(mode != "on" && mode != "off")
+    {
+        std::cerr << "Unknown direct mode \'" << mode << "\', direct mode is either on or off!" << std::endl;
+        return;
+    }
+    
+    std::filesystem::path project_layout_path = chai_path.value().append("projects/" + existing_project + "/project_layout");
+    std::map<std::string, std::vector<std::string>> settings = settings::read_from_file(project_layout_path);
+    
+    settings.insert_or_assign(direct_mode_key, std::vector<std::string>({mode}));
+    
+    settings::write_to_file(settings, project_layout_path);
+}
+
+void command::handle_set_shard_costs(std::string existing_project, std::string path)
+{
+    std::optional<std::filesystem::path> chai_path = command::find_build_folder();
+    
+    if(!chai_path.has_value())
+    {
+        std::cerr << "Cannot find build folder, consider creating a project with 'chai init project_name'!" << std::endl;
+        return;
+    }
+    
+    std::filesystem::path project_root = chai_path.value().parent_path();
+    std::filesystem::path project_layout_path = chai_path.value().append("projects/" + existing_project + "/project_layout");
+    std::map<std::string, std::vector<std::string>> settings = settings::read_from_file(project_layout_path);
+    
+    // Kept relative to the project root, so every checkout of the project finds the same table
+    settings.insert_or_assign(shard_costs_key, std::vector<std::string>({unit_key(std::filesystem::absolute(path).lexically_normal().string(), project_root)}));
+    
+    settings::write_to_file(settings, project_layout_path);
+}
+
 void command::handle_remove_library(std::string existing_project, std::string path) 
 {
     std::optional<std::filesystem::path> chai_path = command::find_build_folder();
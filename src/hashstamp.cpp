@@ -1,10 +1,39 @@
 #include "../include/hashstamp.hpp"
 #include "../include/command.hpp"
 
+#include <cstdint>
 #include <fstream>
+#include <iomanip>
+#include <sstream>
 #include <string>
 #include <iostream>
 
+std::string hashstamp::checksum(const std::string& record)
+{
+    // FNV-1a, enough to tell a torn or garbled record from an intact one
+    uint64_t hash = 14695981039346656037ULL;
+    for(unsigned char character : record)
+    {
+        hash ^= character;
+        hash *= 1099511628211ULL;
+    }
+
+    std::ostringstream returnable;
+    returnable << std::hex << std::setw(16) << std::setfill('0') << hash;
+    return returnable.str();
+}
+
+static void insert_record(std::map<std::string, int>& insertable, const std::string& record)
+{
+    size_t splitter = record.rfind("=");
+    if(splitter == std::string::npos)
+    {
+        return;
+    }
+
+    insertable.insert_or_assign(record.substr(0, splitter), std::stoll(record.substr(splitter + 1)));
+}
+
 std::map<std::string, int> hashstamp::read_from_file()
 {
     std::map<std::string, int> returnable;
@@ -14,19 +43,25 @@ std::map<std::string, int> hashstamp::read_from_file()
     std::ifstream stream(file_path);
     
     std::string current_line = "";
-    int splitter = 0;
     while(std::getline(stream, current_line))
     {
-        splitter = current_line.find("=");
-        returnable.insert(
-            std::make_pair(
-                current_line.substr(0, splitter),
-                std::stoll(current_line.substr(splitter + 1))
-            )
-        );
+        insert_record(returnable, current_line);
     }
     
     stream.close();
+
+    // Journal lines are '<checksum> <file>=<hash>', anything that does not check out was cut short by a crash
+    std::ifstream journal(file_path.replace_filename("hashstamps.journal"));
+    while(std::getline(journal, current_line))
+    {
+        size_t splitter = current_line.find(" ");
+        if(splitter != std::string::npos && current_line.substr(0, splitter) == hashstamp::checksum(current_line.substr(splitter + 1)))
+        {
+            insert_record(returnable, current_line.substr(splitter + 1));
+        }
+    }
+
+    journal.close();
     
     return returnable;
 }
@@ -42,8 +77,9 @@ int hashstamp::write_to_file(std::map<std::string, int> writeable)
     }
     
     std::filesystem::path file_path = chai_path.value().append("cache/hashstamps");
+    std::filesystem::path temp_path = std::filesystem::path(file_path).replace_filename("hashstamps.temp");
     
-    std::ofstream stream(file_path);
+    std::ofstream stream(temp_path);
     
     for(const std::pair<std::string, int>& pair : writeable)
     {
@@ -52,6 +88,33 @@ int hashstamp::write_to_file(std::map<std::string, int> writeable)
     }
     
     stream.close();
+
+    if(!stream)
+    {
+        std::cerr << "Unable to write " << temp_path << ", keeping the build journal instead" << std::endl;
+        return -1;
+    }
+
+    // Swap the new state in whole, then the journal it supersedes can go
+    std::filesystem::rename(temp_path, file_path);
+    std::filesystem::remove(std::filesystem::path(file_path).replace_filename("hashstamps.journal"));
     
     return returnable;
 }
+
+int hashstamp::append_to_journal(std::string source_file, int hash)
+{
+    std::optional<std::filesystem::path> chai_path = command::find_build_folder();
+    if(!chai_path.has_value())
+    {
+        return -1;
+    }
+
+    std::string record = source_file + "=" + std::to_string(hash);
+
+    std::ofstream stream(chai_path.value().append("cache/hashstamps.journal"), std::ios::app);
+    stream << hashstamp::checksum(record) << " " << record << "\n";
+    stream.close();
+
+    return stream ? 1 : -1;
+}
@@ -0,0 +1,114 @@
+#include "../include/history.hpp"
+#include "../include/command.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <iostream>
+
+static const std::string unit_prefix = "unit:";
+
+// Each build is a single line of tab separated key=value fields, so a build that is
+// interrupted mid-write can only ever damage its own record.
+static void apply_field(history::record& record, const std::string& key, const std::string& value)
+{
+    if(key.rfind(unit_prefix, 0) == 0)
+    {
+        record.unit_compile_ns.insert_or_assign(key.substr(unit_prefix.length()), std::stoll(value));
+    } else if(key == "started") { record.started = std::stoll(value); }
+    else if(key == "wall") { record.wall_ns = std::stoll(value); }
+    else if(key == "cpu") { record.cpu_ns = std::stoll(value); }
+    else if(key == "scan") { record.scan_ns = std::stoll(value); }
+    else if(key == "hash") { record.hash_ns = std::stoll(value); }
+    else if(key == "compile") { record.compile_ns = std::stoll(value); }
+    else if(key == "link") { record.link_ns = std::stoll(value); }
+    else if(key == "checked") { record.checked = std::stoi(value); }
+    else if(key == "hashed") { record.hashed = std::stoi(value); }
+    else if(key == "compiled") { record.compiled = std::stoi(value); }
+    else if(key == "cache_hits") { record.cache_hits = std::stoi(value); }
+    else if(key == "direct_hits") { record.direct_hits = std::stoi(value); }
+    else if(key == "preprocessed_bytes") { record.preprocessed_bytes = std::stoll(value); }
+    else if(key == "peak_rss") { record.peak_rss_kb = std::stoll(value); }
+}
+
+std::vector<history::record> history::read_from_file(std::string project_name)
+{
+    std::vector<history::record> returnable;
+    std::optional<std::filesystem::path> chai_path = command::find_build_folder();
+    if(!chai_path.has_value())
+    {
+        return returnable;
+    }
+
+    std::ifstream stream(chai_path.value().append("cache/" + project_name + ".history"));
+
+    std::string current_line = "";
+    std::string field = "";
+    while(std::getline(stream, current_line))
+    {
+        history::record record;
+        std::istringstream fields(current_line);
+
+        try
+        {
+            while(std::getline(fields, field, '\t'))
+            {
+                size_t splitter = field.rfind("=");
+                if(splitter != std::string::npos)
+                {
+                    apply_field(record, field.substr(0, splitter), field.substr(splitter + 1));
+                }
+            }
+        } catch(const std::exception&)
+        {
+            // Torn or hand edited line, skip the whole record
+            continue;
+        }
+
+        if(record.started != 0)
+        {
+            returnable.push_back(record);
+        }
+    }
+
+    stream.close();
+
+    return returnable;
+}
+
+int history::append_to_file(std::string project_name, const history::record& appendable)
+{
+    std::optional<std::filesystem::path> chai_path = command::find_build_folder();
+    if(!chai_path.has_value())
+    {
+        std::cerr << "Cannot find build folder, build history was not recorded!" << std::endl;
+        return -1;
+    }
+
+    std::ostringstream line;
+    line << "started=" << appendable.started
+         << "\twall=" << appendable.wall_ns
+         << "\tcpu=" << appendable.cpu_ns
+         << "\tscan=" << appendable.scan_ns
+         << "\thash=" << appendable.hash_ns
+         << "\tcompile=" << appendable.compile_ns
+         << "\tlink=" << appendable.link_ns
+         << "\tchecked=" << appendable.checked
+         << "\thashed=" << appendable.hashed
+         << "\tcompiled=" << appendable.compiled
+         << "\tcache_hits=" << appendable.cache_hits
+         << "\tdirect_hits=" << appendable.direct_hits
+         << "\tpreprocessed_bytes=" << appendable.preprocessed_bytes
+         << "\tpeak_rss=" << appendable.peak_rss_kb;
+
+    for(const auto& [unit, nanoseconds] : appendable.unit_compile_ns)
+    {
+        line << "\t" << unit_prefix << unit << "=" << nanoseconds;
+    }
+
+    std::ofstream stream(chai_path.value().append("cache/" + project_name + ".history"), std::ios::app);
+    stream << line.str() << std::endl;
+    stream.close();
+
+    return 1 + appendable.unit_compile_ns.size();
+}
@@ -0,0 +1,360 @@
+#include "../include/preprocessed.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+
+std::optional<preprocessed::line_marker> preprocessed::parse_line_marker(const std::string& line)
+{
+    // Markers look like '# 12 "path/to/file.hpp" 1 3', gcc also accepts '#line 12 "file"'
+    size_t position = 0;
+    if(line.rfind("# ", 0) == 0)
+    {
+        position = 2;
+    } else if(line.rfind("#line ", 0) == 0)
+    {
+        position = 6;
+    } else
+    {
+        return std::nullopt;
+    }
+
+    if(position >= line.length() || !std::isdigit(static_cast<unsigned char>(line.at(position))))
+    {
+        return std::nullopt;
+    }
+
+    preprocessed::line_marker marker;
+    size_t quote = line.find('"', position);
+    if(quote == std::string::npos)
+    {
+        return std::nullopt;
+    }
+    marker.line = std::stoll(line.substr(position, quote - position));
+
+    size_t end = quote + 1;
+    while(end < line.length() && line.at(end) != '"')
+    {
+        if(line.at(end) == '\\' && end + 1 < line.length())
+        {
+            end++;
+        }
+        marker.file += line.at(end);
+        end++;
+    }
+
+    for(size_t i = end + 1; i < line.length(); i++)
+    {
+        if(line.at(i) == '1')
+        {
+            marker.enters = true;
+        } else if(line.at(i) == '2')
+        {
+            marker.returns = true;
+        }
+    }
+
+    return std::optional<preprocessed::line_marker>(marker);
+}
+
+std::set<std::string> preprocessed::included_files(const std::string& text)
+{
+    std::set<std::string> returnable;
+
+    size_t start = 0;
+    while(start < text.length())
+    {
+        size_t end = text.find('\n', start);
+        if(end == std::string::npos)
+        {
+            end = text.length();
+        }
+
+        // Markers always start a line, so only those lines need a closer look
+        if(text.compare(start, 2, "# ") == 0 || text.compare(start, 6, "#line ") == 0)
+        {
+            std::optional<preprocessed::line_marker> marker = preprocessed::parse_line_marker(text.substr(start, end - start));
+            if(marker.has_value() && !marker.value().file.empty() && marker.value().file.at(0) != '<' && marker.value().file.back() != '/')
+            {
+                returnable.insert(std::filesystem::absolute(marker.value().file).lexically_normal().string());
+            }
+        }
+        start = end + 1;
+    }
+
+    return returnable;
+}
+
+void preprocessed::attribute_includes(const std::string& text, std::map<std::string, header_cost>& costs)
+{
+    struct frame
+    {
+        std::string file;
+        long long inclusive_bytes = 0;
+    };
+
+    std::map<std::string, preprocessed::header_cost> unit_costs;
+    std::vector<frame> stack;
+    std::string main_file = "";
+
+    auto pop_frame = [&]() {
+        frame popped = stack.back();
+        stack.pop_back();
+        unit_costs[popped.file].inclusive_bytes += popped.inclusive_bytes;
+        stack.back().inclusive_bytes += popped.inclusive_bytes;
+    };
+
+    size_t start = 0;
+    while(start < text.length())
+    {
+        size_t end = text.find('\n', start);
+        if(end == std::string::npos)
+        {
+            end = text.length();
+        }
+        std::string line = text.substr(start, end - start);
+        start = end + 1;
+
+        std::optional<preprocessed::line_marker> marker = preprocessed::parse_line_marker(line);
+        if(marker.has_value())
+        {
+            std::string file = std::filesystem::path(marker.value().file).lexically_normal().string();
+            if(stack.empty())
+            {
+                main_file = file;
+                stack.push_back(frame{file});
+            } else if(marker.value().enters)
+            {
+                stack.push_back(frame{file});
+                if(unit_costs[file].chain.empty())
+                {
+                    for(const frame& includer : stack)
+                    {
+                        unit_costs[file].chain.push_back(includer.file);
+                    }
+                }
+            } else if(marker.value().returns)
+            {
+                while(stack.size() > 1 && stack.back().file != file)
+                {
+                    pop_frame();
+                }
+                // Returning can also land in a different pseudo file of the main unit
+                stack.back().file = file;
+            } else
+            {
+                stack.back().file = file;
+            }
+            continue;
+        }
+
+        if(stack.empty())
+        {
+            continue;
+        }
+
+        stack.back().inclusive_bytes += line.length() + 1;
+        unit_costs[stack.back().file].bytes += line.length() + 1;
+        unit_costs[stack.back().file].lines++;
+    }
+
+    while(stack.size() > 1)
+    {
+        pop_frame();
+    }
+
+    for(auto& [file, cost] : unit_costs)
+    {
+        if(file == main_file || file.empty() || file.at(0) == '<' || cost.chain.empty())
+        {
+            continue;
+        }
+
+        preprocessed::header_cost& total = costs[file];
+        total.bytes += cost.bytes;
+        total.lines += cost.lines;
+        total.inclusive_bytes += cost.inclusive_bytes;
+        total.includers++;
+
+        // Keep the shortest chain so the report is stable regardless of which thread got there first
+        if(total.chain.empty() || cost.chain.size() < total.chain.size() || (cost.chain.size() == total.chain.size() && cost.chain < total.chain))
+        {
+            total.chain = cost.chain;
+        }
+    }
+}
+
+bool preprocessed::is_normalization_mode(const std::string& mode)
+{
+    return mode == "raw" || mode == "paths" || mode == "lines" || mode == "tokens";
+}
+
+static bool is_identifier_character(char character)
+{
+    return std::isalnum(static_cast<unsigned char>(character)) || character == '_' || character == '$';
+}
+
+// Length of the string or character literal starting at text[start], including any raw string delimiters
+static size_t literal_length(const std::string& text, size_t start)
+{
+    char quote = text.at(start);
+
+    if(quote == '"' && start > 0 && text.at(start - 1) == 'R')
+    {
+        size_t open = text.find('(', start);
+        if(open != std::string::npos)
+        {
+            std::string terminator = ")" + text.substr(start + 1, open - start - 1) + "\"";
+            size_t close = text.find(terminator, open);
+            if(close != std::string::npos)
+            {
+                return close + terminator.length() - start;
+            }
+        }
+    }
+
+    size_t end = start + 1;
+    while(end < text.length() && text.at(end) != quote && text.at(end) != '\n')
+    {
+        end += text.at(end) == '\\' ? 2 : 1;
+    }
+
+    return std::min(end + 1, text.length()) - start;
+}
+
+static bool starts_character_literal(const std::string& text, size_t position)
+{
+    // A quote after a number is a digit separator unless the identifier before it is an encoding prefix
+    size_t start = position;
+    while(start > 0 && is_identifier_character(text.at(start - 1)))
+    {
+        start--;
+    }
+
+    std::string prefix = text.substr(start, position - start);
+    return prefix.empty() || prefix == "L" || prefix == "u" || prefix == "U" || prefix == "u8";
+}
+
+static std::string collapse_whitespace(const std::string& text)
+{
+    std::string returnable;
+    returnable.reserve(text.length());
+
+    bool pending_space = false;
+    size_t position = 0;
+    while(position < text.length())
+    {
+        char character = text.at(position);
+
+        if(std::isspace(static_cast<unsigned char>(character)))
+        {
+            pending_space = true;
+            position++;
+            continue;
+        }
+
+        // Whitespace is only kept where dropping it would glue two tokens together
+        if(pending_space && !returnable.empty() && is_identifier_character(returnable.back()) == is_identifier_character(character))
+        {
+            returnable += ' ';
+        }
+        pending_space = false;
+
+        size_t length = 1;
+        if(character == '"' || (character == '\'' && starts_character_literal(text, position)))
+        {
+            length = literal_length(text, position);
+        }
+        returnable.append(text, position, length);
+        position += length;
+    }
+
+    return returnable;
+}
+
+// Skips over every literal that starts in text[position, end), returns where the last one finished. Anything past
+// end means a raw string carries on into the following lines.
+static size_t skip_literals(const std::string& text, size_t position, size_t end)
+{
+    while(position < end)
+    {
+        char character = text.at(position);
+        if(character == '"' || (character == '\'' && starts_character_literal(text, position)))
+        {
+            position += literal_length(text, position);
+        } else
+        {
+            position++;
+        }
+    }
+
+    return position;
+}
+
+std::string preprocessed::normalize(const std::string& text, const std::string& mode, const std::filesystem::path& project_root)
+{
+    if(mode != "paths" && mode != "lines" && mode != "tokens")
+    {
+        return text;
+    }
+
+    std::string returnable;
+    returnable.reserve(text.length());
+
+    size_t start = 0;
+    size_t literal_end = 0;
+    while(start < text.length())
+    {
+        size_t end = text.find('\n', start);
+        if(end == std::string::npos)
+        {
+            end = text.length();
+        }
+        std::string line = text.substr(start, end - start);
+
+        // Lines inside a multi-line raw string are the program's data, blank or marker-like they stay as they are
+        bool inside_literal = start < literal_end;
+        size_t scanned = skip_literals(text, std::max(start, literal_end), end);
+        if(scanned > end)
+        {
+            literal_end = scanned;
+        }
+        start = end + 1;
+
+        if(inside_literal)
+        {
+            returnable += line;
+            returnable += '\n';
+            continue;
+        }
+
+        std::optional<preprocessed::line_marker> marker = preprocessed::parse_line_marker(line);
+        if(mode == "paths")
+        {
+            if(marker.has_value())
+            {
+                std::filesystem::path file = std::filesystem::path(marker.value().file).lexically_normal();
+                std::filesystem::path relative = file.lexically_relative(project_root);
+                if(!relative.empty() && relative.begin()->string() != "..")
+                {
+                    size_t quote = line.find('"');
+                    size_t close = line.find('"', quote + 1 + marker.value().file.length());
+                    line = line.substr(0, quote + 1) + relative.string() + line.substr(close);
+                }
+            }
+        } else if(marker.has_value() || line.find_first_not_of(" \t\r") == std::string::npos)
+        {
+            continue;
+        }
+
+        returnable += line;
+        returnable += '\n';
+    }
+
+    if(mode == "tokens")
+    {
+        return collapse_whitespace(returnable);
+    }
+
+    return returnable;
+}
@@ -0,0 +1,367 @@
+#include "../include/server.hpp"
+#include "../include/command.hpp"
+#include "../include/watcher.hpp"
+
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static volatile std::sig_atomic_t stop_requested = 0;
+
+static void request_stop(int)
+{
+    stop_requested = 1;
+}
+
+static bool make_address(const std::filesystem::path& path, struct sockaddr_un& address)
+{
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if(path.string().length() >= sizeof(address.sun_path))
+    {
+        return false;
+    }
+
+    std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    return true;
+}
+
+static int connect_to(const std::filesystem::path& path)
+{
+    struct sockaddr_un address;
+    if(!make_address(path, address))
+    {
+        return -1;
+    }
+
+    int connection = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(connection >= 0 && connect(connection, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0)
+    {
+        close(connection);
+        return -1;
+    }
+
+    return connection;
+}
+
+// Requests are the client's working directory followed by its arguments, all null terminated and closed by an
+// empty field, with the client's stdin, stdout and stderr attached so output and input go straight to its terminal
+static bool receive_request(int connection, std::vector<std::string>& fields, int (&descriptors)[3])
+{
+    char buffer[4096];
+    char control[CMSG_SPACE(sizeof(descriptors))];
+    std::string payload;
+
+    struct iovec vector = {buffer, sizeof(buffer)};
+    struct msghdr message;
+    std::memset(&message, 0, sizeof(message));
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    ssize_t length = recvmsg(connection, &message, MSG_CMSG_CLOEXEC);
+    struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+    if(length <= 0 || header == nullptr || header->cmsg_type != SCM_RIGHTS || header->cmsg_len != CMSG_LEN(sizeof(descriptors)))
+    {
+        return false;
+    }
+    std::memcpy(descriptors, CMSG_DATA(header), sizeof(descriptors));
+
+    do
+    {
+        payload.append(buffer, length);
+    } while((length = read(connection, buffer, sizeof(buffer))) > 0);
+
+    if(length < 0)
+    {
+        return false;
+    }
+
+    size_t start = 0;
+    size_t end = 0;
+    while((end = payload.find('\0', start)) != std::string::npos)
+    {
+        fields.push_back(payload.substr(start, end - start));
+        start = end + 1;
+    }
+
+    // Without the closing field the client went away mid-request, a cut short argument list must never run
+    if(fields.size() < 3 || fields.back() != "")
+    {
+        return false;
+    }
+    fields.pop_back();
+
+    return true;
+}
+
+static void serve_request(const std::vector<std::string>& fields, std::map<std::string, command::project_state>& projects, watcher& project_watcher, const std::filesystem::path& chai_root)
+{
+    std::filesystem::current_path(fields.at(0));
+
+    std::string request = fields.at(1);
+    std::string project_name = fields.size() > 2 ? fields.at(2) : "";
+    if(fields.size() > 2 && (fields.at(2) == "build" || fields.at(2) == "info"))
+    {
+        request = fields.at(2);
+        project_name = fields.at(1);
+    }
+
+    if(projects.count(project_name) == 0)
+    {
+        std::optional<command::project_state> loaded = command::load_project(project_name);
+        if(!loaded.has_value())
+        {
+            return;
+        }
+
+        projects.insert_or_assign(project_name, loaded.value());
+        std::filesystem::current_path(chai_root);
+        command::watch_project(project_watcher, projects.at(project_name));
+    }
+
+    command::project_state& state = projects.at(project_name);
+    if(request == "info")
+    {
+        std::cout << "This is the current layout of project " << project_name << ": " << std::endl;
+        for(const auto& [key, value] : state.project_layout)
+        {
+            std::cout << "  " << key << ":";
+            for(const std::string& str : value)
+            {
+                std::cout << " " << str;
+            }
+            std::cout << std::endl;
+        }
+    } else if(request == "build")
+    {
+        bool rescan = !state.sources_scanned;
+        command::build_project(project_name, state);
+        if(rescan)
+        {
+            // New source or header directories may have come with a layout change
+            std::filesystem::current_path(chai_root);
+            command::watch_project(project_watcher, state);
+        }
+    }
+}
+
+static void handle_connection(int connection, std::map<std::string, command::project_state>& projects, watcher& project_watcher, const std::filesystem::path& chai_root)
+{
+    std::vector<std::string> fields;
+    int descriptors[3] = {-1, -1, -1};
+
+    if(receive_request(connection, fields, descriptors))
+    {
+        int saved[3];
+        std::cout.flush();
+        std::cerr.flush();
+        for(int i = 0; i < 3; i++)
+        {
+            saved[i] = dup(i);
+            dup2(descriptors[i], i);
+        }
+
+        try
+        {
+            serve_request(fields, projects, project_watcher, chai_root);
+        } catch(const std::exception& exception)
+        {
+            std::cerr << "chai serve failed to handle the request: " << exception.what() << std::endl;
+        }
+
+        std::cout.flush();
+        std::cerr.flush();
+        for(int i = 0; i < 3; i++)
+        {
+            dup2(saved[i], i);
+            close(saved[i]);
+        }
+    }
+
+    for(int descriptor : descriptors)
+    {
+        if(descriptor >= 0)
+        {
+            close(descriptor);
+        }
+    }
+
+    std::filesystem::current_path(chai_root);
+    close(connection);
+}
+
+std::filesystem::path server::socket_path(std::filesystem::path chai_path)
+{
+    return chai_path.append("cache/chai.sock");
+}
+
+int server::serve()
+{
+    std::optional<std::filesystem::path> chai_path = command::find_build_folder();
+
+    if(!chai_path.has_value())
+    {
+        std::cerr << "Cannot find build folder, consider creating a project with 'chai init project_name'!" << std::endl;
+        return -1;
+    }
+
+    std::filesystem::path chai_root = chai_path.value().parent_path();
+    std::filesystem::path listen_path = server::socket_path(chai_path.value());
+    struct sockaddr_un address;
+    if(!make_address(listen_path, address))
+    {
+        std::cerr << "The path " << listen_path << " is too long for a Unix socket, chai serve cannot run here!" << std::endl;
+        return -1;
+    }
+
+    int existing = connect_to(listen_path);
+    if(existing >= 0)
+    {
+        close(existing);
+        std::cerr << "A chai server is already running for " << chai_root << "!" << std::endl;
+        return -1;
+    }
+    // Left behind by a server that did not shut down cleanly
+    std::filesystem::remove(listen_path);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    mode_t previous_mask = umask(0077);
+    int bound = bind(listener, reinterpret_cast<struct sockaddr*>(&address), sizeof(address));
+    umask(previous_mask);
+    if(bound != 0 || listen(listener, 16) != 0)
+    {
+        std::cerr << "Unable to listen on " << listen_path << ": " << std::strerror(errno) << std::endl;
+        close(listener);
+        return -1;
+    }
+
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = request_stop;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+
+    watcher project_watcher;
+    std::map<std::string, command::project_state> projects;
+    std::filesystem::current_path(chai_root);
+
+    std::cout << "chai is serving " << chai_root.string() << " on " << listen_path.string() << ", press Ctrl-C to stop" << std::endl;
+
+    struct pollfd descriptors[2] = {{listener, POLLIN, 0}, {project_watcher.file_descriptor(), POLLIN, 0}};
+    while(!stop_requested)
+    {
+        if(poll(descriptors, project_watcher.file_descriptor() >= 0 ? 2 : 1, -1) < 0)
+        {
+            continue;
+        }
+
+        // Always catch up on file changes before a request, so a save right before 'chai build' is never missed
+        std::set<std::string> changed_paths;
+        bool overflowed = project_watcher.collect_changes(changed_paths);
+        if(overflowed || !changed_paths.empty())
+        {
+            for(auto& [project_name, state] : projects)
+            {
+                command::apply_project_changes(state, changed_paths, overflowed);
+            }
+        }
+
+        if(descriptors[0].revents & POLLIN)
+        {
+            int connection = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+            if(connection >= 0)
+            {
+                handle_connection(connection, projects, project_watcher, chai_root);
+            }
+        }
+    }
+
+    close(listener);
+    std::filesystem::remove(listen_path);
+    std::cout << "chai server stopped" << std::endl;
+
+    return 0;
+}
+
+bool server::forward(int argc, char* argv[])
+{
+    // Programs are never run by the daemon, they belong in the client's session, signals and environment
+    bool forwardable = (argc == 3 && (std::string(argv[1]) == "build" || std::string(argv[1]) == "info"))
+                    || (argc == 3 && (std::string(argv[2]) == "build" || std::string(argv[2]) == "info"));
+    if(!forwardable)
+    {
+        return false;
+    }
+
+    std::optional<std::filesystem::path> chai_path = command::find_build_folder();
+    if(!chai_path.has_value() || !std::filesystem::exists(server::socket_path(chai_path.value())))
+    {
+        return false;
+    }
+
+    int connection = connect_to(server::socket_path(chai_path.value()));
+    if(connection < 0)
+    {
+        return false;
+    }
+
+    std::string payload = std::filesystem::current_path().string() + '\0';
+    for(int i = 1; i < argc; i++)
+    {
+        payload += std::string(argv[i]) + '\0';
+    }
+    payload += '\0';
+
+    int descriptors[3] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+    char control[CMSG_SPACE(sizeof(descriptors))];
+    std::memset(control, 0, sizeof(control));
+
+    struct iovec vector = {payload.data(), payload.size()};
+    struct msghdr message;
+    std::memset(&message, 0, sizeof(message));
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(descriptors));
+    std::memcpy(CMSG_DATA(header), descriptors, sizeof(descriptors));
+
+    ssize_t sent = sendmsg(connection, &message, MSG_NOSIGNAL);
+    size_t total = sent < 0 ? 0 : static_cast<size_t>(sent);
+    while(sent >= 0 && total < payload.size())
+    {
+        sent = send(connection, payload.data() + total, payload.size() - total, MSG_NOSIGNAL);
+        total += sent < 0 ? 0 : static_cast<size_t>(sent);
+    }
+
+    // The daemon only acts on a complete request, so nothing has run yet and the command can still run locally
+    if(sent < 0)
+    {
+        close(connection);
+        return false;
+    }
+    shutdown(connection, SHUT_WR);
+
+    // The server closes the connection once the command has finished, output has already gone to our terminal
+    char ignored[64];
+    while(read(connection, ignored, sizeof(ignored)) > 0) {}
+    close(connection);
+
+    return true;
+}
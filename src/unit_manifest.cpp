@@ -0,0 +1,98 @@
+#include "../include/unit_manifest.hpp"
+#include "../include/command.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <iostream>
+
+// Each unit is a single line of tab separated fields, '<unit> <context> <unit_hash>' followed by one
+// '<input>=<hash>' per file, so a damaged line only ever costs that unit a preprocessing run
+std::map<std::string, unit_manifest::entry> unit_manifest::read_from_file()
+{
+    std::map<std::string, unit_manifest::entry> returnable;
+    std::optional<std::filesystem::path> chai_path = command::find_build_folder();
+    if(!chai_path.has_value())
+    {
+        return returnable;
+    }
+
+    std::ifstream stream(chai_path.value().append("cache/manifests"));
+
+    std::string current_line = "";
+    std::string unit = "";
+    std::string field = "";
+    while(std::getline(stream, current_line))
+    {
+        unit_manifest::entry entry;
+        std::istringstream fields(current_line);
+
+        try
+        {
+            std::getline(fields, unit, '\t');
+            std::getline(fields, field, '\t');
+            entry.context = std::stoull(field);
+            std::getline(fields, field, '\t');
+            entry.unit_hash = std::stoi(field);
+
+            while(std::getline(fields, field, '\t'))
+            {
+                size_t splitter = field.rfind("=");
+                if(splitter != std::string::npos)
+                {
+                    entry.inputs.insert_or_assign(field.substr(0, splitter), std::stoull(field.substr(splitter + 1)));
+                }
+            }
+        } catch(const std::exception&)
+        {
+            continue;
+        }
+
+        if(unit != "" && !entry.inputs.empty())
+        {
+            returnable.insert_or_assign(unit, entry);
+        }
+    }
+
+    stream.close();
+
+    return returnable;
+}
+
+int unit_manifest::write_to_file(const std::map<std::string, unit_manifest::entry>& writeable)
+{
+    int returnable = 0;
+    std::optional<std::filesystem::path> chai_path = command::find_build_folder();
+    if(!chai_path.has_value())
+    {
+        return -1;
+    }
+
+    std::filesystem::path file_path = chai_path.value().append("cache/manifests");
+    std::filesystem::path temp_path = std::filesystem::path(file_path).replace_filename("manifests.temp");
+
+    std::ofstream stream(temp_path);
+
+    for(const auto& [unit, entry] : writeable)
+    {
+        stream << unit << "\t" << entry.context << "\t" << entry.unit_hash;
+        for(const auto& [input, hash] : entry.inputs)
+        {
+            stream << "\t" << input << "=" << hash;
+        }
+        stream << std::endl;
+        returnable++;
+    }
+
+    stream.close();
+
+    if(!stream)
+    {
+        std::cerr << "Unable to write " << temp_path << ", the next build will preprocess to find its cache hits" << std::endl;
+        return -1;
+    }
+
+    std::filesystem::rename(temp_path, file_path);
+
+    return returnable;
+}
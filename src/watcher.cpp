@@ -0,0 +1,155 @@
+#include "../include/watcher.hpp"
+
+#include <iostream>
+
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+static const uint32_t watch_mask = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF;
+
+watcher::watcher()
+{
+    inotify_descriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(inotify_descriptor < 0)
+    {
+        std::cerr << "Unable to start watching files, inotify is unavailable!" << std::endl;
+    }
+}
+
+watcher::~watcher()
+{
+    if(inotify_descriptor >= 0)
+    {
+        close(inotify_descriptor);
+    }
+}
+
+int watcher::file_descriptor() const
+{
+    return inotify_descriptor;
+}
+
+void watcher::watch(const std::filesystem::path& directory)
+{
+    std::filesystem::path normal = std::filesystem::absolute(directory).lexically_normal();
+    if(inotify_descriptor < 0 || !std::filesystem::is_directory(normal))
+    {
+        return;
+    }
+
+    int watch_descriptor = inotify_add_watch(inotify_descriptor, normal.c_str(), watch_mask);
+    if(watch_descriptor >= 0)
+    {
+        watched_directories.insert_or_assign(watch_descriptor, normal);
+    }
+}
+
+void watcher::watch_recursive(const std::filesystem::path& directory)
+{
+    std::filesystem::path normal = std::filesystem::absolute(directory).lexically_normal();
+    if(inotify_descriptor < 0 || !std::filesystem::is_directory(normal))
+    {
+        return;
+    }
+
+    watch(normal);
+
+    std::error_code error;
+    for(const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(normal, error))
+    {
+        // Object and temp directories live under .chai, never watch chai's own output
+        if(entry.is_directory() && entry.path().filename() != ".chai")
+        {
+            watch_recursive(entry.path());
+        }
+    }
+}
+
+bool watcher::read_events(std::set<std::string>& changed_paths)
+{
+    bool overflowed = false;
+    alignas(struct inotify_event) char buffer[16384];
+
+    ssize_t length = 0;
+    while((length = read(inotify_descriptor, buffer, sizeof(buffer))) > 0)
+    {
+        for(char* position = buffer; position < buffer + length; )
+        {
+            struct inotify_event* event = reinterpret_cast<struct inotify_event*>(position);
+            position += sizeof(struct inotify_event) + event->len;
+
+            if(event->mask & IN_Q_OVERFLOW)
+            {
+                overflowed = true;
+                continue;
+            }
+
+            if(event->mask & IN_IGNORED)
+            {
+                watched_directories.erase(event->wd);
+                continue;
+            }
+
+            if(watched_directories.count(event->wd) == 0 || event->len == 0)
+            {
+                continue;
+            }
+
+            std::filesystem::path changed = watched_directories.at(event->wd) / event->name;
+            changed_paths.insert(changed.string());
+
+            if((event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO)))
+            {
+                watch_recursive(changed);
+                // Files written before the watch was in place would otherwise go unnoticed
+                std::error_code error;
+                for(const std::filesystem::directory_entry& entry : std::filesystem::recursive_directory_iterator(changed, error))
+                {
+                    changed_paths.insert(entry.path().lexically_normal().string());
+                }
+            }
+        }
+    }
+
+    return overflowed;
+}
+
+bool watcher::collect_changes(std::set<std::string>& changed_paths)
+{
+    if(inotify_descriptor < 0)
+    {
+        return false;
+    }
+
+    return read_events(changed_paths);
+}
+
+bool watcher::wait_for_changes(std::set<std::string>& changed_paths, int debounce_milliseconds)
+{
+    if(inotify_descriptor < 0)
+    {
+        return false;
+    }
+
+    bool overflowed = false;
+    struct pollfd descriptor = {inotify_descriptor, POLLIN, 0};
+
+    while(changed_paths.empty() && !overflowed)
+    {
+        if(poll(&descriptor, 1, -1) < 0)
+        {
+            // Interrupted, let the caller decide whether to stop
+            return overflowed;
+        }
+        overflowed |= read_events(changed_paths);
+    }
+
+    // Editors tend to save in bursts (write, rename, chmod), wait for things to settle before building
+    while(poll(&descriptor, 1, debounce_milliseconds) > 0)
+    {
+        overflowed |= read_events(changed_paths);
+    }
+
+    return overflowed;
+}